@@ -0,0 +1,722 @@
+// Drives HTTP/1.1 or HTTP/2 load through envoy over vcl and reports throughput, latency and cpu
+// cost per request. Optionally runs a built-in HTTP/1.1 origin, also over vcl, for the proxy to
+// forward to, so a run needs nothing but vpp and envoy.
+//
+// Usage: vcl_loadgen --target <ip:port> [--origin <ip:port>] [--protocol http1|http2]
+//                    [--threads N] [--connections N] [--streams N] [--duration S]
+//                    [--mix <path>:<request body bytes>:<weight>,...] [--response-bytes N]
+//
+// Connections are spread over threads, each a vcl worker with its own dispatcher. Load is closed
+// loop: every connection keeps one request, or --streams HTTP/2 streams, outstanding. Requests
+// are picked from the mix by weight. Responses must carry a content-length.
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "envoy/config/bootstrap/v3/bootstrap.pb.h"
+
+#include "source/common/api/api_impl.h"
+#include "source/common/buffer/buffer_impl.h"
+#include "source/common/common/posix/thread_impl.h"
+#include "source/common/common/random_generator.h"
+#include "source/common/event/real_time_system.h"
+#include "source/common/filesystem/posix/filesystem_impl.h"
+#include "source/common/network/utility.h"
+#include "source/common/stats/isolated_store_impl.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "fmt/format.h"
+#include "nghttp2/nghttp2.h"
+#include "vcl/vcl_interface.h"
+#include "vcl/vcl_io_handle.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Network {
+namespace Vcl {
+namespace {
+
+constexpr uint32_t BodyChunk = 64 * 1024;
+const char body_data[BodyChunk] = {};
+
+struct RequestKind {
+  std::string path;
+  uint32_t body_bytes;
+  uint32_t weight;
+};
+
+struct Options {
+  Envoy::Network::Address::InstanceConstSharedPtr target;
+  Envoy::Network::Address::InstanceConstSharedPtr origin;
+  bool http2{false};
+  uint32_t threads{1};
+  uint32_t connections{16};
+  uint32_t streams{1};
+  uint32_t duration_s{10};
+  uint32_t response_bytes{0};
+  std::vector<RequestKind> mix{{"/", 0, 1}};
+};
+
+double threadCpuSeconds() {
+  struct rusage usage;
+  getrusage(RUSAGE_THREAD, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Handles may be closed from their own callbacks, destroy them once the dispatcher returns
+void deferredClose(Event::Dispatcher& dispatcher, std::unique_ptr<VclStreamIoHandle>& io_handle) {
+  io_handle->close();
+  std::shared_ptr<VclStreamIoHandle> closed(std::move(io_handle));
+  dispatcher.post([closed]() {});
+}
+
+// Content-length of the message whose headers are in headers, or -1 if missing.
+int64_t contentLength(absl::string_view headers) {
+  for (absl::string_view line : absl::StrSplit(headers, "\r\n")) {
+    auto colon = line.find(':');
+    if (colon == absl::string_view::npos ||
+        !absl::EqualsIgnoreCase(line.substr(0, colon), "content-length")) {
+      continue;
+    }
+    int64_t length;
+    if (absl::SimpleAtoi(absl::StripAsciiWhitespace(line.substr(colon + 1)), &length)) {
+      return length;
+    }
+  }
+  return -1;
+}
+
+// Splits the first complete message, headers and content-length body, off the front of buffer.
+// Returns false if buffer doesn't hold one yet. Messages without content-length are malformed and
+// taken to have no body.
+bool nextMessage(Buffer::Instance& buffer, std::string& headers, bool& malformed) {
+  const ssize_t end = buffer.search("\r\n\r\n", 4, 0, 0);
+  if (end < 0) {
+    return false;
+  }
+  std::string head(static_cast<const char*>(buffer.linearize(end)), end);
+  const int64_t content_length = contentLength(head);
+  if (buffer.length() < end + 4 + std::max<int64_t>(content_length, 0)) {
+    return false;
+  }
+  malformed = content_length < 0;
+  headers = std::move(head);
+  buffer.drain(end + 4 + std::max<int64_t>(content_length, 0));
+  return true;
+}
+
+// Load of one thread, merged once the run is over.
+struct ThreadResult {
+  uint64_t requests{0};
+  uint64_t errors{0};
+  uint64_t reconnects{0};
+  std::vector<uint64_t> latencies_ns;
+  double cpu_s{0};
+};
+
+class LoadThread;
+
+class ClientConnection {
+public:
+  explicit ClientConnection(LoadThread& thread) : thread_(thread) {}
+  virtual ~ClientConnection() = default;
+
+  void connect();
+  void close();
+
+protected:
+  virtual void onConnected() PURE;
+  virtual void onData() PURE;
+
+  void flush();
+  void onEvents(uint32_t events);
+  void onClosed();
+
+  LoadThread& thread_;
+  std::unique_ptr<VclStreamIoHandle> io_handle_;
+  Buffer::OwnedImpl in_;
+  Buffer::OwnedImpl out_;
+  bool connected_{false};
+};
+
+using ClientConnectionPtr = std::unique_ptr<ClientConnection>;
+
+class LoadThread {
+public:
+  LoadThread(const Options& options, Api::Api& api, uint32_t index, uint32_t n_connections);
+
+  void run();
+  ThreadResult& result() { return result_; }
+  Event::Dispatcher& dispatcher() { return *dispatcher_; }
+  const Options& options() const { return options_; }
+  bool running() const { return running_; }
+
+  const RequestKind& pickRequest() { return options_.mix[pick_(random_)]; }
+  void recordResponse(std::chrono::steady_clock::time_point start, bool ok) {
+    result_.requests++;
+    result_.errors += !ok;
+    result_.latencies_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                       std::chrono::steady_clock::now() - start)
+                                       .count());
+  }
+
+private:
+  const Options& options_;
+  Api::Api& api_;
+  const uint32_t n_connections_;
+  Event::DispatcherPtr dispatcher_;
+  Event::TimerPtr stop_timer_;
+  std::vector<ClientConnectionPtr> connections_;
+  std::mt19937 random_;
+  std::discrete_distribution<size_t> pick_;
+  bool running_{true};
+  ThreadResult result_;
+};
+
+void ClientConnection::connect() {
+  int sh = vppcom_session_create(VPPCOM_PROTO_TCP, 1);
+  if (sh < 0) {
+    thread_.result().errors++;
+    return;
+  }
+  io_handle_ = std::make_unique<VclStreamIoHandle>(sh);
+  connected_ = false;
+  in_.drain(in_.length());
+  out_.drain(out_.length());
+  auto result = io_handle_->connect(thread_.options().target);
+  if (result.return_value_ && result.errno_ != EINPROGRESS) {
+    thread_.result().errors++;
+    deferredClose(thread_.dispatcher(), io_handle_);
+    return;
+  }
+  io_handle_->initializeFileEvent(
+      thread_.dispatcher(), [this](uint32_t events) { onEvents(events); },
+      Event::FileTriggerType::Edge,
+      Event::FileReadyType::Read | Event::FileReadyType::Write | Event::FileReadyType::Closed);
+}
+
+void ClientConnection::close() {
+  if (io_handle_) {
+    deferredClose(thread_.dispatcher(), io_handle_);
+  }
+}
+
+void ClientConnection::flush() {
+  while (out_.length()) {
+    auto result = io_handle_->write(out_);
+    if (!result.ok() || result.return_value_ == 0) {
+      break;
+    }
+  }
+}
+
+void ClientConnection::onEvents(uint32_t events) {
+  if (events & Event::FileReadyType::Closed) {
+    onClosed();
+    return;
+  }
+  if (!connected_ && (events & Event::FileReadyType::Write)) {
+    connected_ = true;
+    onConnected();
+  }
+  if (events & Event::FileReadyType::Read) {
+    while (true) {
+      auto result = io_handle_->read(in_, absl::nullopt);
+      if (!result.ok()) {
+        break;
+      }
+      if (result.return_value_ == 0) {
+        onClosed();
+        return;
+      }
+    }
+    onData();
+  }
+  if (io_handle_ && (events & Event::FileReadyType::Write)) {
+    flush();
+  }
+}
+
+void ClientConnection::onClosed() {
+  close();
+  if (thread_.running()) {
+    thread_.result().reconnects++;
+    connect();
+  }
+}
+
+// One request outstanding at a time, on a keep-alive connection.
+class Http1Connection : public ClientConnection {
+public:
+  using ClientConnection::ClientConnection;
+
+private:
+  void onConnected() override { sendRequest(); }
+
+  void onData() override {
+    std::string headers;
+    bool malformed;
+    while (nextMessage(in_, headers, malformed)) {
+      thread_.recordResponse(start_, !malformed && absl::StartsWith(headers, "HTTP/1.1 200"));
+      if (!thread_.running()) {
+        return;
+      }
+      sendRequest();
+    }
+  }
+
+  void sendRequest() {
+    const RequestKind& kind = thread_.pickRequest();
+    out_.add(fmt::format("{} {} HTTP/1.1\r\nhost: vcl-loadgen\r\ncontent-length: {}\r\n\r\n",
+                         kind.body_bytes ? "POST" : "GET", kind.path, kind.body_bytes));
+    for (uint32_t left = kind.body_bytes; left;) {
+      const uint32_t len = std::min(left, BodyChunk);
+      out_.add(body_data, len);
+      left -= len;
+    }
+    start_ = std::chrono::steady_clock::now();
+    flush();
+  }
+
+  std::chrono::steady_clock::time_point start_;
+};
+
+// --streams streams outstanding at a time, with prior knowledge.
+class Http2Connection : public ClientConnection {
+public:
+  explicit Http2Connection(LoadThread& thread) : ClientConnection(thread) {}
+  ~Http2Connection() override {
+    if (session_) {
+      nghttp2_session_del(session_);
+    }
+  }
+
+private:
+  struct Stream {
+    std::chrono::steady_clock::time_point start;
+    uint32_t body_left;
+    bool ok{false};
+  };
+
+  void onConnected() override {
+    if (session_) {
+      nghttp2_session_del(session_);
+      streams_.clear();
+    }
+    nghttp2_session_callbacks* callbacks;
+    nghttp2_session_callbacks_new(&callbacks);
+    nghttp2_session_callbacks_set_send_callback(callbacks, onSend);
+    nghttp2_session_callbacks_set_on_header_callback(callbacks, onHeader);
+    nghttp2_session_callbacks_set_on_stream_close_callback(callbacks, onStreamClose);
+    nghttp2_session_client_new(&session_, callbacks, this);
+    nghttp2_session_callbacks_del(callbacks);
+
+    nghttp2_submit_settings(session_, NGHTTP2_FLAG_NONE, nullptr, 0);
+    for (uint32_t i = 0; i < thread_.options().streams; i++) {
+      submitRequest();
+    }
+    send();
+  }
+
+  void onData() override {
+    for (const Buffer::RawSlice& slice : in_.getRawSlices()) {
+      if (nghttp2_session_mem_recv(session_, static_cast<const uint8_t*>(slice.mem_),
+                                   slice.len_) < 0) {
+        thread_.result().errors++;
+        break;
+      }
+    }
+    in_.drain(in_.length());
+    send();
+  }
+
+  void submitRequest() {
+    const RequestKind& kind = thread_.pickRequest();
+    const std::string body_len = std::to_string(kind.body_bytes);
+    auto header = [](const char* name, const std::string& value) {
+      return nghttp2_nv{reinterpret_cast<uint8_t*>(const_cast<char*>(name)),
+                        reinterpret_cast<uint8_t*>(const_cast<char*>(value.data())),
+                        strlen(name), value.size(), NGHTTP2_NV_FLAG_NONE};
+    };
+    const std::string method = kind.body_bytes ? "POST" : "GET";
+    const std::string scheme = "http";
+    const std::string authority = "vcl-loadgen";
+    const nghttp2_nv headers[] = {header(":method", method), header(":scheme", scheme),
+                                  header(":authority", authority), header(":path", kind.path),
+                                  header("content-length", body_len)};
+
+    auto stream = std::make_unique<Stream>(Stream{std::chrono::steady_clock::now(),
+                                                  kind.body_bytes});
+    nghttp2_data_provider provider;
+    provider.source.ptr = stream.get();
+    provider.read_callback = onReadBody;
+    int32_t stream_id = nghttp2_submit_request(session_, nullptr, headers,
+                                               sizeof(headers) / sizeof(headers[0]),
+                                               kind.body_bytes ? &provider : nullptr, nullptr);
+    if (stream_id < 0) {
+      thread_.result().errors++;
+      return;
+    }
+    streams_[stream_id] = std::move(stream);
+  }
+
+  void send() {
+    nghttp2_session_send(session_);
+    flush();
+  }
+
+  static ssize_t onSend(nghttp2_session*, const uint8_t* data, size_t length, int, void* user) {
+    static_cast<Http2Connection*>(user)->out_.add(data, length);
+    return length;
+  }
+
+  static int onHeader(nghttp2_session*, const nghttp2_frame* frame, const uint8_t* name,
+                      size_t name_len, const uint8_t* value, size_t value_len, uint8_t,
+                      void* user) {
+    auto* connection = static_cast<Http2Connection*>(user);
+    auto it = connection->streams_.find(frame->hd.stream_id);
+    if (it != connection->streams_.end() &&
+        absl::string_view(reinterpret_cast<const char*>(name), name_len) == ":status") {
+      it->second->ok = absl::string_view(reinterpret_cast<const char*>(value), value_len) == "200";
+    }
+    return 0;
+  }
+
+  static int onStreamClose(nghttp2_session*, int32_t stream_id, uint32_t error_code, void* user) {
+    auto* connection = static_cast<Http2Connection*>(user);
+    auto it = connection->streams_.find(stream_id);
+    if (it == connection->streams_.end()) {
+      return 0;
+    }
+    connection->thread_.recordResponse(it->second->start, !error_code && it->second->ok);
+    connection->streams_.erase(it);
+    if (connection->thread_.running()) {
+      connection->submitRequest();
+    }
+    return 0;
+  }
+
+  static ssize_t onReadBody(nghttp2_session*, int32_t, uint8_t* buf, size_t length,
+                            uint32_t* data_flags, nghttp2_data_source* source, void*) {
+    auto* stream = static_cast<Stream*>(source->ptr);
+    const uint32_t len = std::min<uint64_t>({length, stream->body_left, BodyChunk});
+    memcpy(buf, body_data, len);
+    stream->body_left -= len;
+    if (!stream->body_left) {
+      *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+    }
+    return len;
+  }
+
+  nghttp2_session* session_{nullptr};
+  absl::flat_hash_map<int32_t, std::unique_ptr<Stream>> streams_;
+};
+
+LoadThread::LoadThread(const Options& options, Api::Api& api, uint32_t index,
+                       uint32_t n_connections)
+    : options_(options), api_(api), n_connections_(n_connections), random_(index) {
+  std::vector<uint32_t> weights;
+  for (const auto& kind : options.mix) {
+    weights.push_back(kind.weight);
+  }
+  pick_ = std::discrete_distribution<size_t>(weights.begin(), weights.end());
+}
+
+void LoadThread::run() {
+  vcl_interface_worker_register();
+  dispatcher_ = api_.allocateDispatcher("vcl_loadgen");
+  const double start_cpu = threadCpuSeconds();
+
+  for (uint32_t i = 0; i < n_connections_; i++) {
+    if (options_.http2) {
+      connections_.push_back(std::make_unique<Http2Connection>(*this));
+    } else {
+      connections_.push_back(std::make_unique<Http1Connection>(*this));
+    }
+    connections_.back()->connect();
+  }
+  stop_timer_ = dispatcher_->createTimer([this]() {
+    running_ = false;
+    for (auto& connection : connections_) {
+      connection->close();
+    }
+    dispatcher_->exit();
+  });
+  stop_timer_->enableTimer(std::chrono::seconds(options_.duration_s));
+  dispatcher_->run(Event::Dispatcher::RunType::Block);
+
+  // Deliver the deferred closes before the connections go away
+  dispatcher_->run(Event::Dispatcher::RunType::NonBlock);
+  connections_.clear();
+  result_.cpu_s = threadCpuSeconds() - start_cpu;
+}
+
+// Built-in origin. Answers every request with a 200 and --response-bytes of body.
+class Origin {
+public:
+  Origin(const Options& options, Api::Api& api) : options_(options), api_(api) {}
+
+  // Listens on the main thread, like envoy's listeners, before the origin's worker accepts.
+  bool listen() {
+    int sh = vppcom_session_create(VPPCOM_PROTO_TCP, 1);
+    if (sh < 0) {
+      return false;
+    }
+    listener_ = std::make_unique<VclStreamIoHandle>(sh);
+    return !listener_->bind(options_.origin).return_value_ && !listener_->listen(1024).return_value_;
+  }
+
+  void start() {
+    thread_ = api_.threadFactory().createThread([this]() { run(); },
+                                                Thread::Options{std::string("vcl_origin")});
+  }
+
+  double stop() {
+    dispatcher_->exit();
+    thread_->join();
+    return cpu_s_;
+  }
+
+private:
+  struct Session {
+    std::unique_ptr<VclStreamIoHandle> io_handle;
+    Buffer::OwnedImpl in;
+    Buffer::OwnedImpl out;
+  };
+
+  void run() {
+    vcl_interface_worker_register();
+    const double start_cpu = threadCpuSeconds();
+    dispatcher_ = api_.allocateDispatcher("vcl_origin");
+    listener_->initializeFileEvent(
+        *dispatcher_, [this](uint32_t) { onAccept(); }, Event::FileTriggerType::Edge,
+        Event::FileReadyType::Read);
+    dispatcher_->run(Event::Dispatcher::RunType::Block);
+    for (auto& session : sessions_) {
+      deferredClose(*dispatcher_, session.second->io_handle);
+    }
+    dispatcher_->run(Event::Dispatcher::RunType::NonBlock);
+    sessions_.clear();
+    listener_->close();
+    cpu_s_ = threadCpuSeconds() - start_cpu;
+  }
+
+  void onAccept() {
+    sockaddr_storage ss;
+    socklen_t ss_len = sizeof(ss);
+    while (auto io_handle = listener_->accept(reinterpret_cast<sockaddr*>(&ss), &ss_len)) {
+      auto session = std::make_unique<Session>();
+      session->io_handle.reset(static_cast<VclStreamIoHandle*>(io_handle.release()));
+      Session* raw = session.get();
+      session->io_handle->initializeFileEvent(
+          *dispatcher_, [this, raw](uint32_t events) { onSessionEvents(*raw, events); },
+          Event::FileTriggerType::Edge,
+          Event::FileReadyType::Read | Event::FileReadyType::Write | Event::FileReadyType::Closed);
+      sessions_[raw] = std::move(session);
+    }
+  }
+
+  void onSessionEvents(Session& session, uint32_t events) {
+    bool closed = events & Event::FileReadyType::Closed;
+    while (!closed && (events & Event::FileReadyType::Read)) {
+      auto result = session.io_handle->read(session.in, absl::nullopt);
+      if (!result.ok()) {
+        break;
+      }
+      closed = result.return_value_ == 0;
+    }
+    std::string headers;
+    bool malformed;
+    while (nextMessage(session.in, headers, malformed)) {
+      session.out.add(fmt::format("HTTP/1.1 200 OK\r\ncontent-length: {}\r\n\r\n",
+                                  options_.response_bytes));
+      for (uint32_t left = options_.response_bytes; left;) {
+        const uint32_t len = std::min(left, BodyChunk);
+        session.out.add(body_data, len);
+        left -= len;
+      }
+    }
+    while (!closed && session.out.length()) {
+      auto result = session.io_handle->write(session.out);
+      if (!result.ok() || result.return_value_ == 0) {
+        break;
+      }
+    }
+    if (closed) {
+      deferredClose(*dispatcher_, session.io_handle);
+      sessions_.erase(&session);
+    }
+  }
+
+  const Options& options_;
+  Api::Api& api_;
+  std::unique_ptr<VclStreamIoHandle> listener_;
+  Event::DispatcherPtr dispatcher_;
+  Thread::ThreadPtr thread_;
+  absl::flat_hash_map<Session*, std::unique_ptr<Session>> sessions_;
+  double cpu_s_{0};
+};
+
+bool parseMix(const std::string& arg, std::vector<RequestKind>& mix) {
+  mix.clear();
+  for (absl::string_view entry : absl::StrSplit(arg, ',')) {
+    std::vector<absl::string_view> fields = absl::StrSplit(entry, ':');
+    RequestKind kind;
+    if (fields.size() != 3 || fields[0].empty() || fields[0][0] != '/' ||
+        !absl::SimpleAtoi(fields[1], &kind.body_bytes) ||
+        !absl::SimpleAtoi(fields[2], &kind.weight)) {
+      return false;
+    }
+    kind.path = std::string(fields[0]);
+    mix.push_back(kind);
+  }
+  return !mix.empty();
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string arg = argv[i];
+    const std::string value = argv[i + 1];
+    bool ok = true;
+    if (arg == "--target" || arg == "--origin") {
+      try {
+        (arg == "--target" ? options.target : options.origin) =
+            Envoy::Network::Utility::parseInternetAddressAndPort(value, false);
+      } catch (const EnvoyException&) {
+        ok = false;
+      }
+    } else if (arg == "--protocol") {
+      ok = value == "http1" || value == "http2";
+      options.http2 = value == "http2";
+    } else if (arg == "--threads") {
+      ok = absl::SimpleAtoi(value, &options.threads) && options.threads;
+    } else if (arg == "--connections") {
+      ok = absl::SimpleAtoi(value, &options.connections) && options.connections;
+    } else if (arg == "--streams") {
+      ok = absl::SimpleAtoi(value, &options.streams) && options.streams;
+    } else if (arg == "--duration") {
+      ok = absl::SimpleAtoi(value, &options.duration_s) && options.duration_s;
+    } else if (arg == "--response-bytes") {
+      ok = absl::SimpleAtoi(value, &options.response_bytes);
+    } else if (arg == "--mix") {
+      ok = parseMix(value, options.mix);
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      std::cerr << fmt::format("invalid argument {} {}\n", arg, value);
+      return false;
+    }
+  }
+  return options.target != nullptr;
+}
+
+uint64_t percentile(const std::vector<uint64_t>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  return sorted[std::min<size_t>(sorted.size() * p, sorted.size() - 1)];
+}
+
+int loadgenMain(int argc, char** argv) {
+  Options options;
+  if (argc % 2 == 0 || !parseOptions(argc, argv, options)) {
+    std::cerr << "usage: vcl_loadgen --target <ip:port> [--origin <ip:port>] "
+                 "[--protocol http1|http2] [--threads N] [--connections N] [--streams N] "
+                 "[--duration S] [--mix <path>:<request body bytes>:<weight>,...] "
+                 "[--response-bytes N]\n";
+    return 1;
+  }
+
+  Thread::ThreadFactoryImplPosix thread_factory;
+  Filesystem::InstanceImplPosix file_system;
+  Event::RealTimeSystem time_system;
+  Stats::IsolatedStoreImpl stats_store;
+  Random::RandomGeneratorImpl random;
+  Api::Impl api(thread_factory, stats_store, time_system, file_system, random,
+                envoy::config::bootstrap::v3::Bootstrap());
+
+  if (vppcom_app_create("vcl_loadgen") != VPPCOM_OK) {
+    std::cerr << "failed to attach to vpp\n";
+    return 1;
+  }
+  vcl_epoll_handle(0) = vppcom_epoll_create();
+
+  std::unique_ptr<Origin> origin;
+  if (options.origin) {
+    origin = std::make_unique<Origin>(options, api);
+    if (!origin->listen()) {
+      std::cerr << fmt::format("origin failed to listen on {}\n", options.origin->asString());
+      return 1;
+    }
+    origin->start();
+  }
+
+  std::vector<std::unique_ptr<LoadThread>> load_threads;
+  std::vector<Thread::ThreadPtr> threads;
+  for (uint32_t i = 0; i < options.threads; i++) {
+    // Spread connections evenly, earlier threads take the remainder
+    const uint32_t n_connections =
+        options.connections / options.threads + (i < options.connections % options.threads);
+    load_threads.push_back(std::make_unique<LoadThread>(options, api, i, n_connections));
+  }
+  const auto start = std::chrono::steady_clock::now();
+  for (auto& load_thread : load_threads) {
+    threads.push_back(thread_factory.createThread([&load_thread]() { load_thread->run(); },
+                                                  Thread::Options{std::string("vcl_loadgen")}));
+  }
+  for (auto& thread : threads) {
+    thread->join();
+  }
+  const double wall_s =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  const double origin_cpu_s = origin ? origin->stop() : 0;
+
+  ThreadResult total;
+  for (auto& load_thread : load_threads) {
+    ThreadResult& result = load_thread->result();
+    total.requests += result.requests;
+    total.errors += result.errors;
+    total.reconnects += result.reconnects;
+    total.cpu_s += result.cpu_s;
+    total.latencies_ns.insert(total.latencies_ns.end(), result.latencies_ns.begin(),
+                              result.latencies_ns.end());
+  }
+  std::sort(total.latencies_ns.begin(), total.latencies_ns.end());
+  const double requests = std::max<uint64_t>(total.requests, 1);
+
+  std::cout << fmt::format("requests {} errors {} reconnects {} wall {:.2f}s rps {:.1f}\n",
+                           total.requests, total.errors, total.reconnects, wall_s,
+                           total.requests / wall_s);
+  std::cout << fmt::format("latency us: p50 {:.1f} p90 {:.1f} p99 {:.1f} p99.9 {:.1f} max {:.1f}\n",
+                           percentile(total.latencies_ns, 0.5) / 1e3,
+                           percentile(total.latencies_ns, 0.9) / 1e3,
+                           percentile(total.latencies_ns, 0.99) / 1e3,
+                           percentile(total.latencies_ns, 0.999) / 1e3,
+                           percentile(total.latencies_ns, 1) / 1e3);
+  std::cout << fmt::format("cpu per request us: loadgen {:.2f} origin {:.2f}\n",
+                           total.cpu_s * 1e6 / requests, origin_cpu_s * 1e6 / requests);
+  return total.requests && !total.errors ? 0 : 2;
+}
+
+} // namespace
+} // namespace Vcl
+} // namespace Network
+} // namespace Extensions
+} // namespace Envoy
+
+int main(int argc, char** argv) {
+  return Envoy::Extensions::Network::Vcl::loadgenMain(argc, argv);
+}
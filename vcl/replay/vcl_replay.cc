@@ -0,0 +1,336 @@
+// Replays a vcl event capture, written by the /vcl/capture admin endpoint, through the adaptor
+// against the vppcom stand-in. Used to compare the adaptor's dispatch cost across changes without
+// vpp or network load.
+//
+// Usage: vcl_replay [--realtime] <capture file>
+//
+// Epoll events, accepts and the bytes read and written per session are replayed as recorded.
+// Batches of events run back to back unless --realtime is set, in which case the recorded gaps
+// between batches are honoured.
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "envoy/config/bootstrap/v3/bootstrap.pb.h"
+
+#include "source/common/api/api_impl.h"
+#include "source/common/buffer/buffer_impl.h"
+#include "source/common/common/posix/thread_impl.h"
+#include "source/common/common/random_generator.h"
+#include "source/common/event/real_time_system.h"
+#include "source/common/filesystem/posix/filesystem_impl.h"
+#include "source/common/network/address_impl.h"
+#include "source/common/stats/isolated_store_impl.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "fmt/format.h"
+#include "vcl/replay/vppcom_standin.h"
+#include "vcl/vcl_interface.h"
+#include "vcl/vcl_io_handle.h"
+#include "vcl/vcl_trace.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Network {
+namespace Vcl {
+namespace {
+
+constexpr uint32_t TxChunk = 64 * 1024;
+char tx_data[TxChunk];
+
+bool loadCapture(const std::string& path, VclCaptureHeader& header,
+                 std::vector<VclTraceRecord>& records) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+    std::cerr << fmt::format("{}: failed to read capture header\n", path);
+    return false;
+  }
+  if (header.magic != VclCaptureHeader::Magic || header.version != VclCaptureHeader::Version ||
+      header.record_size != sizeof(VclTraceRecord)) {
+    std::cerr << fmt::format("{}: not a vcl capture or unsupported version\n", path);
+    return false;
+  }
+  VclTraceRecord record;
+  while (file.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+    records.push_back(record);
+  }
+  return true;
+}
+
+bool isBatchRecord(VclTraceType type) {
+  return type == VclTraceType::MqEvents || type == VclTraceType::EpollEvent;
+}
+
+double cpuSeconds() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+class VclReplay {
+public:
+  VclReplay(Event::Dispatcher& dispatcher) : dispatcher_(dispatcher) {}
+
+  bool listen() {
+    // Listener is created on the main worker and listened on by the replay worker, like envoy's
+    // listeners.
+    listener_ = std::make_unique<VclStreamIoHandle>(vppcom_session_create(VPPCOM_PROTO_TCP, 1));
+    auto address = std::make_shared<Envoy::Network::Address::Ipv4Instance>("127.0.0.1", 8080);
+    if (listener_->bind(address).return_value_ || listener_->listen(128).return_value_) {
+      return false;
+    }
+    vcl_interface_worker_register();
+    listener_->initializeFileEvent(
+        dispatcher_, [this](uint32_t) { onAccept(); }, Event::FileTriggerType::Edge,
+        Event::FileReadyType::Read);
+    return VppcomStandin::listenerSh() != ~0U;
+  }
+
+  // Replays the records of one batch: the epoll events reported by vpp and what the adaptor read,
+  // wrote, accepted and closed while they were delivered.
+  void replayBatch(const VclTraceRecord* records, size_t n_records) {
+    for (size_t i = 0; i < n_records; i++) {
+      const VclTraceRecord& record = records[i];
+      switch (record.type) {
+      case VclTraceType::Accept: {
+        const uint32_t sh = VppcomStandin::newSession(VPPCOM_PROTO_TCP);
+        sessions_map_[record.sh] = sh;
+        VppcomStandin::queueAccept(sh);
+        break;
+      }
+      case VclTraceType::Read:
+      case VclTraceType::Recv:
+      case VclTraceType::RecvMsg:
+        // Peeked bytes are recorded again when read
+        if (record.type == VclTraceType::Recv && (record.events & MSG_PEEK)) {
+          break;
+        }
+        if (record.bytes > 0 && sessions_map_.contains(record.sh)) {
+          VppcomStandin::addRxBytes(sessions_map_[record.sh], record.bytes);
+        }
+        break;
+      case VclTraceType::Write:
+      case VclTraceType::SendMsg:
+        if (record.bytes > 0 && sessions_map_.contains(record.sh)) {
+          auto it = sessions_.find(sessions_map_[record.sh]);
+          if (it != sessions_.end()) {
+            it->second.pending_tx += record.bytes;
+          }
+        }
+        break;
+      case VclTraceType::Close:
+        if (sessions_map_.contains(record.sh)) {
+          to_close_.push_back(sessions_map_[record.sh]);
+          sessions_map_.erase(record.sh);
+        }
+        break;
+      default:
+        break;
+      }
+    }
+
+    for (size_t i = 0; i < n_records; i++) {
+      const VclTraceRecord& record = records[i];
+      if (record.type != VclTraceType::EpollEvent) {
+        continue;
+      }
+      auto it = sessions_map_.find(record.sh);
+      // Sessions not accepted during the capture are listeners
+      const uint32_t sh = it != sessions_map_.end() ? it->second : VppcomStandin::listenerSh();
+      VppcomStandin::injectEvents(sh, record.events);
+      n_events_++;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    dispatcher_.run(Event::Dispatcher::RunType::NonBlock);
+    for (uint32_t sh : to_close_) {
+      closeSession(sh);
+    }
+    latencies_.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - start)
+                             .count());
+    to_close_.clear();
+    closed_.clear();
+  }
+
+  void report(std::chrono::nanoseconds wall, double cpu) {
+    std::sort(latencies_.begin(), latencies_.end());
+    auto percentile = [this](double p) -> uint64_t {
+      if (latencies_.empty()) {
+        return 0;
+      }
+      return latencies_[std::min<size_t>(latencies_.size() * p, latencies_.size() - 1)];
+    };
+    std::cout << fmt::format("batches {} events {} accepted {} rx bytes {} tx bytes {}\n",
+                             latencies_.size(), n_events_, n_accepted_,
+                             VppcomStandin::bytesRead(), VppcomStandin::bytesWritten());
+    std::cout << fmt::format("wall {:.3f}ms cpu {:.3f}ms\n", wall.count() / 1e6, cpu * 1e3);
+    std::cout << fmt::format("batch latency ns: p50 {} p90 {} p99 {} max {}\n", percentile(0.5),
+                             percentile(0.9), percentile(0.99), percentile(1));
+  }
+
+private:
+  struct ReplaySession {
+    Envoy::Network::IoHandlePtr io_handle;
+    uint64_t pending_tx{0};
+  };
+
+  void onAccept() {
+    sockaddr_storage ss;
+    socklen_t ss_len = sizeof(ss);
+    while (auto io_handle = listener_->accept(reinterpret_cast<sockaddr*>(&ss), &ss_len)) {
+      auto* vcl_handle = static_cast<VclIoHandle*>(io_handle.get());
+      const uint32_t sh = vcl_handle->sh();
+      vcl_handle->initializeFileEvent(
+          dispatcher_, [this, sh](uint32_t events) { onSessionEvents(sh, events); },
+          Event::FileTriggerType::Edge,
+          Event::FileReadyType::Read | Event::FileReadyType::Write | Event::FileReadyType::Closed);
+      sessions_[sh].io_handle = std::move(io_handle);
+      n_accepted_++;
+    }
+  }
+
+  void onSessionEvents(uint32_t sh, uint32_t events) {
+    auto it = sessions_.find(sh);
+    if (it == sessions_.end()) {
+      return;
+    }
+    ReplaySession& session = it->second;
+    if (events & Event::FileReadyType::Closed) {
+      closeSession(sh);
+      return;
+    }
+    if (events & Event::FileReadyType::Read) {
+      Buffer::OwnedImpl buffer;
+      while (true) {
+        auto result = session.io_handle->read(buffer, absl::nullopt);
+        if (!result.ok() || result.return_value_ == 0) {
+          break;
+        }
+        buffer.drain(buffer.length());
+      }
+    }
+    while (session.pending_tx) {
+      Buffer::RawSlice slice{tx_data, std::min<uint64_t>(session.pending_tx, TxChunk)};
+      auto result = session.io_handle->writev(&slice, 1);
+      if (!result.ok() || result.return_value_ == 0) {
+        break;
+      }
+      session.pending_tx -= result.return_value_;
+    }
+  }
+
+  void closeSession(uint32_t sh) {
+    auto it = sessions_.find(sh);
+    if (it == sessions_.end()) {
+      return;
+    }
+    it->second.io_handle->close();
+    // Callbacks may still be on the stack, destroy handles once the dispatcher returns
+    closed_.push_back(std::move(it->second.io_handle));
+    sessions_.erase(it);
+  }
+
+  Event::Dispatcher& dispatcher_;
+  std::unique_ptr<VclStreamIoHandle> listener_;
+  // Captured session handle to stand-in session handle
+  absl::flat_hash_map<uint32_t, uint32_t> sessions_map_;
+  absl::flat_hash_map<uint32_t, ReplaySession> sessions_;
+  std::vector<uint32_t> to_close_;
+  std::vector<Envoy::Network::IoHandlePtr> closed_;
+  std::vector<uint64_t> latencies_;
+  uint64_t n_events_{0};
+  uint64_t n_accepted_{0};
+};
+
+int replayMain(int argc, char** argv) {
+  bool realtime = false;
+  std::string path;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--realtime") {
+      realtime = true;
+    } else {
+      path = arg;
+    }
+  }
+  if (path.empty()) {
+    std::cerr << "usage: vcl_replay [--realtime] <capture file>\n";
+    return 1;
+  }
+
+  VclCaptureHeader header;
+  std::vector<VclTraceRecord> records;
+  if (!loadCapture(path, header, records)) {
+    return 1;
+  }
+
+  Thread::ThreadFactoryImplPosix thread_factory;
+  Filesystem::InstanceImplPosix file_system;
+  Event::RealTimeSystem time_system;
+  Stats::IsolatedStoreImpl stats_store;
+  Random::RandomGeneratorImpl random;
+  Api::Impl api(thread_factory, stats_store, time_system, file_system, random,
+                envoy::config::bootstrap::v3::Bootstrap());
+  Event::DispatcherPtr dispatcher = api.allocateDispatcher("vcl_replay");
+
+  vppcom_app_create("vcl_replay");
+  vcl_epoll_handle(0) = vppcom_epoll_create();
+
+  VclReplay replay(*dispatcher);
+  if (!replay.listen()) {
+    std::cerr << "failed to set up replay listener\n";
+    return 1;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  const double start_cpu = cpuSeconds();
+  uint64_t first_timestamp = 0;
+
+  size_t i = 0;
+  // Records before the first batch are setup, e.g., listens
+  while (i < records.size() && records[i].type != VclTraceType::MqEvents) {
+    i++;
+  }
+  while (i < records.size()) {
+    // A batch spans one or more epoll waits and everything done until the next one
+    size_t end = i;
+    while (end < records.size() && isBatchRecord(records[end].type)) {
+      end++;
+    }
+    while (end < records.size() && !isBatchRecord(records[end].type)) {
+      end++;
+    }
+
+    if (realtime && header.ticks_per_sec) {
+      if (!first_timestamp) {
+        first_timestamp = records[i].timestamp;
+      }
+      const auto offset = std::chrono::nanoseconds(static_cast<uint64_t>(
+          (records[i].timestamp - first_timestamp) * 1e9 / header.ticks_per_sec));
+      std::this_thread::sleep_until(start + offset);
+    }
+    replay.replayBatch(&records[i], end - i);
+    i = end;
+  }
+
+  replay.report(std::chrono::steady_clock::now() - start, cpuSeconds() - start_cpu);
+  return 0;
+}
+
+} // namespace
+} // namespace Vcl
+} // namespace Network
+} // namespace Extensions
+} // namespace Envoy
+
+int main(int argc, char** argv) {
+  return Envoy::Extensions::Network::Vcl::replayMain(argc, argv);
+}
@@ -0,0 +1,431 @@
+#include "vcl/replay/vppcom_standin.h"
+
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+
+extern "C" {
+#include "vpp/include/vpp-api/client/stat_client.h"
+}
+
+namespace Envoy {
+namespace Extensions {
+namespace Network {
+namespace Vcl {
+namespace VppcomStandin {
+namespace {
+
+constexpr uint32_t MaxWorkers = 128;
+constexpr uint32_t InvalidHandle = ~0U;
+// Same handle layout as vcl
+constexpr uint32_t WorkerShift = 24;
+constexpr uint32_t SessionMask = (1 << WorkerShift) - 1;
+constexpr uint32_t FifoSize = 1 << 20;
+
+struct StandinSession {
+  uint8_t proto{0};
+  bool is_listener{false};
+  uint64_t rx_bytes{0};
+  // Bytes handed out by read_segments and not yet freed
+  uint64_t rx_pending{0};
+  // Epoll registration
+  bool registered{false};
+  uint32_t epoll_events{0};
+  uint64_t epoll_data{0};
+  uint32_t attr_flags{0};
+};
+
+struct StandinWorker {
+  bool registered{false};
+  int mq_fd{-1};
+  uint32_t next_session{1};
+  absl::flat_hash_map<uint32_t, StandinSession> sessions;
+  std::deque<std::pair<uint32_t, uint32_t>> pending_events;
+  std::deque<uint32_t> pending_accepts;
+  uint32_t listener_sh{InvalidHandle};
+  uint32_t bound_sh{InvalidHandle};
+};
+
+StandinWorker workers[MaxWorkers];
+std::atomic<int> n_workers{0};
+thread_local int wrk_index = -1;
+
+// Backing store for reads and segments. Contents are irrelevant for replay.
+char rx_data[FifoSize];
+std::atomic<uint64_t> total_read{0};
+std::atomic<uint64_t> total_written{0};
+
+inline uint32_t shWorker(uint32_t sh) { return sh >> WorkerShift; }
+
+StandinSession* lookup(uint32_t sh) {
+  if (shWorker(sh) >= MaxWorkers) {
+    return nullptr;
+  }
+  auto& sessions = workers[shWorker(sh)].sessions;
+  auto it = sessions.find(sh);
+  return it == sessions.end() ? nullptr : &it->second;
+}
+
+StandinWorker& currentWorker() { return workers[wrk_index < 0 ? 0 : wrk_index]; }
+
+void fillEndpt(vppcom_endpt_t* ep, uint16_t port) {
+  if (ep == nullptr) {
+    return;
+  }
+  ep->is_ip4 = 1;
+  ep->port = htons(port);
+  if (ep->ip) {
+    const uint8_t localhost[4] = {127, 0, 0, 1};
+    memcpy(ep->ip, localhost, sizeof(localhost));
+  }
+}
+
+int registerWorker() {
+  const int index = n_workers.fetch_add(1);
+  if (index >= static_cast<int>(MaxWorkers)) {
+    return VPPCOM_ENOMEM;
+  }
+  StandinWorker& wrk = workers[index];
+  wrk.mq_fd = eventfd(0, EFD_NONBLOCK);
+  wrk.registered = true;
+  wrk_index = index;
+  return VPPCOM_OK;
+}
+
+void signalMq(StandinWorker& wrk) {
+  const uint64_t one = 1;
+  // Only fails if the counter would overflow, in which case the fd is readable anyway
+  [[maybe_unused]] ssize_t rv = write(wrk.mq_fd, &one, sizeof(one));
+}
+
+int consume(uint32_t sh, uint32_t n) {
+  StandinSession* s = lookup(sh);
+  if (s == nullptr) {
+    return VPPCOM_EBADFD;
+  }
+  if (!s->rx_bytes) {
+    return VPPCOM_EAGAIN;
+  }
+  const uint32_t len = std::min<uint64_t>({n, s->rx_bytes, FifoSize});
+  s->rx_bytes -= len;
+  total_read += len;
+  return len;
+}
+
+} // namespace
+
+uint32_t newSession(uint8_t proto) {
+  StandinWorker& wrk = currentWorker();
+  const uint32_t sh = (static_cast<uint32_t>(std::max(wrk_index, 0)) << WorkerShift) |
+                      (wrk.next_session++ & SessionMask);
+  wrk.sessions[sh].proto = proto;
+  return sh;
+}
+
+void addRxBytes(uint32_t sh, uint32_t bytes) {
+  StandinSession* s = lookup(sh);
+  if (s) {
+    s->rx_bytes += bytes;
+  }
+}
+
+void queueAccept(uint32_t sh) { currentWorker().pending_accepts.push_back(sh); }
+
+uint32_t listenerSh() { return currentWorker().listener_sh; }
+
+uint32_t boundSh() { return currentWorker().bound_sh; }
+
+void injectEvents(uint32_t sh, uint32_t epoll_events) {
+  StandinWorker& wrk = currentWorker();
+  wrk.pending_events.emplace_back(sh, epoll_events);
+  signalMq(wrk);
+}
+
+uint64_t bytesRead() { return total_read.load(); }
+uint64_t bytesWritten() { return total_written.load(); }
+
+} // namespace VppcomStandin
+} // namespace Vcl
+} // namespace Network
+} // namespace Extensions
+} // namespace Envoy
+
+using namespace Envoy::Extensions::Network::Vcl::VppcomStandin;
+
+// vppcom api, declared extern "C" by vppcom.h
+
+int vppcom_app_create(const char*) { return registerWorker(); }
+
+int vppcom_worker_register(void) { return registerWorker(); }
+
+int vppcom_worker_index(void) { return wrk_index; }
+
+void vppcom_worker_index_set(int index) { wrk_index = index; }
+
+int vppcom_mq_epoll_fd(void) { return currentWorker().mq_fd; }
+
+int vppcom_session_index(vcl_session_handle_t session_handle) {
+  return session_handle & SessionMask;
+}
+
+int vppcom_session_worker(vcl_session_handle_t session_handle) {
+  return shWorker(session_handle);
+}
+
+int vppcom_session_create(uint8_t proto, uint8_t) { return newSession(proto); }
+
+int vppcom_session_close(uint32_t session_handle) {
+  if (!lookup(session_handle)) {
+    return VPPCOM_EBADFD;
+  }
+  workers[shWorker(session_handle)].sessions.erase(session_handle);
+  return VPPCOM_OK;
+}
+
+int vppcom_add_cert_key_pair(vppcom_cert_key_pair_t*) {
+  static int n_ckpairs = 0;
+  return n_ckpairs++;
+}
+
+int vppcom_session_shutdown(uint32_t session_handle, int) {
+  return lookup(session_handle) ? VPPCOM_OK : VPPCOM_EBADFD;
+}
+
+int vppcom_session_bind(uint32_t session_handle, vppcom_endpt_t*) {
+  if (!lookup(session_handle)) {
+    return VPPCOM_EBADFD;
+  }
+  workers[shWorker(session_handle)].bound_sh = session_handle;
+  return VPPCOM_OK;
+}
+
+int vppcom_session_listen(uint32_t session_handle, uint32_t) {
+  StandinSession* s = lookup(session_handle);
+  if (s == nullptr) {
+    return VPPCOM_EBADFD;
+  }
+  s->is_listener = true;
+  StandinWorker& wrk = workers[shWorker(session_handle)];
+  if (wrk.listener_sh == InvalidHandle) {
+    wrk.listener_sh = session_handle;
+  }
+  return VPPCOM_OK;
+}
+
+int vppcom_session_accept(uint32_t listen_session_handle, vppcom_endpt_t* client_ep, uint32_t) {
+  StandinSession* s = lookup(listen_session_handle);
+  if (s == nullptr || !s->is_listener) {
+    return VPPCOM_EBADFD;
+  }
+  auto& pending = currentWorker().pending_accepts;
+  if (pending.empty()) {
+    return VPPCOM_EAGAIN;
+  }
+  const uint32_t sh = pending.front();
+  pending.pop_front();
+  fillEndpt(client_ep, 10000 + (sh & 0xffff) % 50000);
+  return sh;
+}
+
+int vppcom_session_connect(uint32_t session_handle, vppcom_endpt_t*) {
+  return lookup(session_handle) ? VPPCOM_OK : VPPCOM_EBADFD;
+}
+
+int vppcom_session_read(uint32_t session_handle, void* buf, size_t n) {
+  const int rv = consume(session_handle, n);
+  if (rv > 0) {
+    memcpy(buf, rx_data, rv);
+  }
+  return rv;
+}
+
+int vppcom_session_recvfrom(uint32_t session_handle, void* buffer, uint32_t buflen, int flags,
+                            vppcom_endpt_t* ep) {
+  StandinSession* s = lookup(session_handle);
+  if (s && (flags & MSG_PEEK)) {
+    const uint32_t len = std::min<uint64_t>({buflen, s->rx_bytes, FifoSize});
+    if (!len) {
+      return VPPCOM_EAGAIN;
+    }
+    memcpy(buffer, rx_data, len);
+    return len;
+  }
+  const int rv = vppcom_session_read(session_handle, buffer, buflen);
+  if (rv > 0) {
+    fillEndpt(ep, 10000);
+  }
+  return rv;
+}
+
+int vppcom_session_read_segments(uint32_t session_handle, vppcom_data_segment_t* ds,
+                                 uint32_t n_segments, uint32_t max_bytes) {
+  StandinSession* s = lookup(session_handle);
+  if (s == nullptr) {
+    return VPPCOM_EBADFD;
+  }
+  // Like vcl, segments start past the ones already handed out
+  const uint64_t available = std::min<uint64_t>(s->rx_bytes, FifoSize) - s->rx_pending;
+  if (!available || !n_segments) {
+    return VPPCOM_EAGAIN;
+  }
+  const uint32_t len = std::min<uint64_t>(max_bytes, available);
+  ds[0].data = reinterpret_cast<uint8_t*>(rx_data) + s->rx_pending;
+  ds[0].len = len;
+  s->rx_pending += len;
+  return len;
+}
+
+void vppcom_session_free_segments(uint32_t session_handle, uint32_t n_bytes) {
+  StandinSession* s = lookup(session_handle);
+  if (s) {
+    n_bytes = std::min<uint64_t>(n_bytes, s->rx_pending);
+    s->rx_pending -= n_bytes;
+    s->rx_bytes -= n_bytes;
+    total_read += n_bytes;
+  }
+}
+
+int vppcom_session_write(uint32_t session_handle, void*, size_t n) {
+  if (!lookup(session_handle)) {
+    return VPPCOM_EBADFD;
+  }
+  total_written += n;
+  return n;
+}
+
+int vppcom_session_write_msg(uint32_t session_handle, void* buf, size_t n) {
+  return vppcom_session_write(session_handle, buf, n);
+}
+
+int vppcom_session_sendto(uint32_t session_handle, void* buffer, uint32_t buflen, int,
+                          vppcom_endpt_t*) {
+  return vppcom_session_write(session_handle, buffer, buflen);
+}
+
+int vppcom_session_attr(uint32_t session_handle, uint32_t op, void* buffer, uint32_t* buflen) {
+  StandinSession* s = lookup(session_handle);
+  if (s == nullptr) {
+    return VPPCOM_EBADFD;
+  }
+  auto setU32 = [buffer, buflen](uint32_t val) {
+    if (buffer && buflen && *buflen >= sizeof(uint32_t)) {
+      *static_cast<uint32_t*>(buffer) = val;
+      *buflen = sizeof(uint32_t);
+    }
+  };
+  switch (op) {
+  case VPPCOM_ATTR_GET_NREAD:
+    return std::min<uint64_t>(s->rx_bytes, FifoSize);
+  case VPPCOM_ATTR_GET_NWRITE:
+    return FifoSize;
+  case VPPCOM_ATTR_GET_RX_FIFO_LEN:
+  case VPPCOM_ATTR_GET_TX_FIFO_LEN:
+    setU32(FifoSize);
+    return VPPCOM_OK;
+  case VPPCOM_ATTR_GET_PROTOCOL:
+    setU32(s->proto);
+    return VPPCOM_OK;
+  case VPPCOM_ATTR_GET_LISTEN:
+    setU32(s->is_listener);
+    return VPPCOM_OK;
+  case VPPCOM_ATTR_GET_FLAGS:
+    setU32(s->attr_flags);
+    return VPPCOM_OK;
+  case VPPCOM_ATTR_SET_FLAGS:
+    if (buffer && buflen && *buflen >= sizeof(uint32_t)) {
+      s->attr_flags = *static_cast<uint32_t*>(buffer);
+    }
+    return VPPCOM_OK;
+  case VPPCOM_ATTR_GET_LCL_ADDR:
+    fillEndpt(static_cast<vppcom_endpt_t*>(buffer), 8080);
+    return VPPCOM_OK;
+  case VPPCOM_ATTR_GET_PEER_ADDR:
+    fillEndpt(static_cast<vppcom_endpt_t*>(buffer), 10000);
+    return VPPCOM_OK;
+  default:
+    // Socket options are accepted and read back as 0
+    setU32(0);
+    return VPPCOM_OK;
+  }
+}
+
+int vppcom_epoll_create(void) {
+  const int sh = newSession(0);
+  return sh;
+}
+
+int vppcom_epoll_ctl(uint32_t, int op, uint32_t session_handle, struct epoll_event* event) {
+  StandinSession* s = lookup(session_handle);
+  if (s == nullptr) {
+    return VPPCOM_EBADFD;
+  }
+  switch (op) {
+  case EPOLL_CTL_ADD:
+  case EPOLL_CTL_MOD:
+    s->registered = true;
+    s->epoll_events = event->events;
+    s->epoll_data = event->data.u64;
+    return VPPCOM_OK;
+  case EPOLL_CTL_DEL:
+    s->registered = false;
+    return VPPCOM_OK;
+  default:
+    return VPPCOM_EINVAL;
+  }
+}
+
+int vppcom_epoll_wait(uint32_t, struct epoll_event* events, int maxevents, double) {
+  StandinWorker& wrk = currentWorker();
+  uint64_t counter;
+  // Fails with EAGAIN if nothing was signaled, pending events are still drained below
+  [[maybe_unused]] ssize_t rv = read(wrk.mq_fd, &counter, sizeof(counter));
+  int n_events = 0;
+  while (n_events < maxevents && !wrk.pending_events.empty()) {
+    const auto [sh, pending] = wrk.pending_events.front();
+    wrk.pending_events.pop_front();
+    StandinSession* s = lookup(sh);
+    if (s == nullptr || !s->registered) {
+      continue;
+    }
+    const uint32_t ready = pending & (s->epoll_events | EPOLLERR | EPOLLHUP);
+    if (!ready) {
+      continue;
+    }
+    events[n_events].events = ready;
+    events[n_events].data.u64 = s->epoll_data;
+    n_events++;
+  }
+  // Leftovers are reported on the next wakeup
+  if (!wrk.pending_events.empty()) {
+    signalMq(wrk);
+  }
+  return n_events;
+}
+
+// Stats segment client. Replays never reach vpp's stats, these only satisfy the link.
+
+int stat_segment_connect(const char*) { return -1; }
+
+void stat_segment_disconnect(void) {}
+
+uint8_t** stat_segment_string_vector(uint8_t**, const char*) { return nullptr; }
+
+uint32_t* stat_segment_ls(uint8_t**) { return nullptr; }
+
+stat_segment_data_t* stat_segment_dump(uint32_t*) { return nullptr; }
+
+void stat_segment_data_free(stat_segment_data_t*) {}
+
+int stat_segment_vec_len(void*) { return 0; }
+
+void stat_segment_vec_free(void*) {}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+#include "vpp/include/vcl/vppcom.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Network {
+namespace Vcl {
+namespace VppcomStandin {
+
+// Local stand-in for libvppcom. It implements the vppcom calls the adaptor makes against in memory
+// sessions, so recorded event streams can be replayed through the adaptor without vpp. Sessions
+// have unbounded tx space and rx data is only what the replay driver queues. Control functions
+// below act on the calling thread's worker.
+
+// Allocates a session on the calling worker, e.g., to be returned by a later accept.
+uint32_t newSession(uint8_t proto);
+// Makes bytes available for reads on the session.
+void addRxBytes(uint32_t sh, uint32_t bytes);
+// Queues a session to be returned by the next accept on any listener of the calling worker.
+void queueAccept(uint32_t sh);
+// First session the adaptor started listening on, or VPPCOM's invalid handle if none.
+uint32_t listenerSh();
+// Last session the adaptor bound on the calling worker, or VPPCOM's invalid handle if none.
+uint32_t boundSh();
+// Queues epoll events for the session and signals the worker's mq eventfd. Events are reported
+// by vppcom_epoll_wait if the session is registered with an epoll handle.
+void injectEvents(uint32_t sh, uint32_t epoll_events);
+
+// Totals since start
+uint64_t bytesRead();
+uint64_t bytesWritten();
+
+} // namespace VppcomStandin
+} // namespace Vcl
+} // namespace Network
+} // namespace Extensions
+} // namespace Envoy
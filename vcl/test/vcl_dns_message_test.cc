@@ -0,0 +1,274 @@
+#include <string>
+#include <vector>
+
+#include "vcl/vcl_dns_message.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Network {
+namespace Vcl {
+namespace {
+
+constexpr uint16_t QtypeCname = 5;
+// Offset of the question's name, which answers point back to
+constexpr uint8_t QuestionName = 12;
+
+// Builds responses to a single question one record at a time.
+class ResponseBuilder {
+public:
+  ResponseBuilder(uint16_t id, const std::string& name, uint16_t qtype, uint16_t rcode = 0) {
+    append16(id);
+    append16(0x8180 | rcode);
+    append16(1);
+    append16(0);
+    append16(0);
+    append16(0);
+    appendName(name);
+    append16(qtype);
+    append16(1);
+  }
+
+  // Appends a record whose name is a pointer to offset. Returns the offset of its rdata.
+  size_t record(uint8_t offset, uint16_t type, uint32_t ttl, const std::vector<uint8_t>& rdata) {
+    bytes_.push_back(0xc0);
+    bytes_.push_back(offset);
+    append16(type);
+    append16(1);
+    append16(ttl >> 16);
+    append16(ttl & 0xffff);
+    append16(rdata.size());
+    const size_t rdata_offset = bytes_.size();
+    bytes_.insert(bytes_.end(), rdata.begin(), rdata.end());
+    // ancount
+    const uint16_t ancount = (bytes_[6] << 8 | bytes_[7]) + 1;
+    bytes_[6] = ancount >> 8;
+    bytes_[7] = ancount & 0xff;
+    return rdata_offset;
+  }
+
+  static std::vector<uint8_t> name(const std::string& name) {
+    ResponseBuilder builder;
+    builder.appendName(name);
+    return builder.bytes_;
+  }
+
+  std::vector<uint8_t>& bytes() { return bytes_; }
+
+private:
+  ResponseBuilder() = default;
+
+  void append16(uint16_t v) {
+    bytes_.push_back(v >> 8);
+    bytes_.push_back(v & 0xff);
+  }
+
+  void appendName(const std::string& name) {
+    std::string query;
+    ASSERT_TRUE(vclDnsEncodeQuery(0, name, 0, query));
+    // The name sits between the header and the qtype and qclass
+    bytes_.insert(bytes_.end(), query.begin() + VclDnsHeaderSize, query.end() - 4);
+  }
+
+  std::vector<uint8_t> bytes_;
+};
+
+TEST(VclDnsMessageTest, EncodeQuery) {
+  std::string query;
+  ASSERT_TRUE(vclDnsEncodeQuery(0x1234, "www.example.com.", VclDnsQtypeAaaa, query));
+  const std::string expected("\x12\x34\x01\x00\x00\x01\x00\x00\x00\x00\x00\x00"
+                             "\x03www\x07"
+                             "example\x03"
+                             "com\x00\x00\x1c\x00\x01",
+                             33);
+  EXPECT_EQ(expected, query);
+  EXPECT_EQ(0x1234, vclDnsMessageId(reinterpret_cast<const uint8_t*>(query.data())));
+}
+
+TEST(VclDnsMessageTest, EncodeQueryInvalidName) {
+  std::string query;
+  EXPECT_FALSE(vclDnsEncodeQuery(1, "", VclDnsQtypeA, query));
+  EXPECT_FALSE(vclDnsEncodeQuery(1, "...", VclDnsQtypeA, query));
+  EXPECT_FALSE(vclDnsEncodeQuery(1, std::string(64, 'a') + ".com", VclDnsQtypeA, query));
+  EXPECT_TRUE(vclDnsEncodeQuery(1, std::string(63, 'a') + ".com", VclDnsQtypeA, query));
+
+  // 4 labels of 63 bytes and their lengths take 256 bytes, 1 more with the root label
+  std::string label(63, 'a');
+  EXPECT_FALSE(vclDnsEncodeQuery(1, label + "." + label + "." + label + "." + label,
+                                 VclDnsQtypeA, query));
+  EXPECT_TRUE(vclDnsEncodeQuery(1, label + "." + label + "." + label + "." + label.substr(2),
+                                VclDnsQtypeA, query));
+}
+
+TEST(VclDnsMessageTest, SkipName) {
+  std::vector<uint8_t> name = ResponseBuilder::name("www.example.com");
+  uint64_t offset = 0;
+  EXPECT_TRUE(vclDnsSkipName(name.data(), name.size(), offset));
+  EXPECT_EQ(name.size(), offset);
+
+  // Truncated before the root label
+  offset = 0;
+  EXPECT_FALSE(vclDnsSkipName(name.data(), name.size() - 1, offset));
+
+  // Labels followed by a compression pointer
+  std::vector<uint8_t> compressed{3, 'w', 'w', 'w', 0xc0, 12};
+  offset = 0;
+  EXPECT_TRUE(vclDnsSkipName(compressed.data(), compressed.size(), offset));
+  EXPECT_EQ(compressed.size(), offset);
+
+  // Pointer missing its second byte
+  offset = 0;
+  EXPECT_FALSE(vclDnsSkipName(compressed.data(), compressed.size() - 1, offset));
+
+  // Reserved label types
+  std::vector<uint8_t> reserved{0x40, 0};
+  offset = 0;
+  EXPECT_FALSE(vclDnsSkipName(reserved.data(), reserved.size(), offset));
+  reserved[0] = 0x80;
+  offset = 0;
+  EXPECT_FALSE(vclDnsSkipName(reserved.data(), reserved.size(), offset));
+
+  // A pointer to itself isn't followed, so can't loop
+  std::vector<uint8_t> loop{0xc0, 0};
+  offset = 0;
+  EXPECT_TRUE(vclDnsSkipName(loop.data(), loop.size(), offset));
+  EXPECT_EQ(2, offset);
+}
+
+TEST(VclDnsMessageTest, ParseCompressedAnswers) {
+  ResponseBuilder builder(7, "example.com", VclDnsQtypeA);
+  builder.record(QuestionName, VclDnsQtypeA, 300, {192, 0, 2, 1});
+  builder.record(QuestionName, VclDnsQtypeA, 60, {192, 0, 2, 2});
+  std::vector<uint8_t>& bytes = builder.bytes();
+
+  VclDnsResponse response;
+  ASSERT_TRUE(vclDnsParseResponse(bytes.data(), bytes.size(), VclDnsQtypeA, response));
+  EXPECT_EQ(VclDnsRcodeNoError, response.rcode);
+  ASSERT_EQ(2, response.addresses.size());
+  EXPECT_EQ("192.0.2.1:0", response.addresses[0].first->asString());
+  EXPECT_EQ(std::chrono::seconds(300), response.addresses[0].second);
+  EXPECT_EQ("192.0.2.2:0", response.addresses[1].first->asString());
+  EXPECT_EQ(std::chrono::seconds(60), response.addresses[1].second);
+}
+
+TEST(VclDnsMessageTest, ParseAaaa) {
+  ResponseBuilder builder(7, "example.com", VclDnsQtypeAaaa);
+  builder.record(QuestionName, VclDnsQtypeAaaa, 30,
+                 {0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1});
+  // A records in an AAAA response are ignored
+  builder.record(QuestionName, VclDnsQtypeA, 30, {192, 0, 2, 1});
+  std::vector<uint8_t>& bytes = builder.bytes();
+
+  VclDnsResponse response;
+  ASSERT_TRUE(vclDnsParseResponse(bytes.data(), bytes.size(), VclDnsQtypeAaaa, response));
+  ASSERT_EQ(1, response.addresses.size());
+  EXPECT_EQ("[2001:db8::1]:0", response.addresses[0].first->asString());
+}
+
+TEST(VclDnsMessageTest, ParseCnameChain) {
+  // www.example.com -> web.example.com -> cdn.example.net -> 192.0.2.9
+  ResponseBuilder builder(7, "www.example.com", VclDnsQtypeA);
+  std::vector<uint8_t> web{3, 'w', 'e', 'b', 0xc0, QuestionName + 4};
+  const size_t web_offset = builder.record(QuestionName, QtypeCname, 3600, web);
+  const size_t cdn_offset = builder.record(web_offset, QtypeCname, 3600,
+                                           ResponseBuilder::name("cdn.example.net"));
+  builder.record(cdn_offset, VclDnsQtypeA, 20, {192, 0, 2, 9});
+  std::vector<uint8_t>& bytes = builder.bytes();
+
+  VclDnsResponse response;
+  ASSERT_TRUE(vclDnsParseResponse(bytes.data(), bytes.size(), VclDnsQtypeA, response));
+  ASSERT_EQ(1, response.addresses.size());
+  EXPECT_EQ("192.0.2.9:0", response.addresses[0].first->asString());
+  EXPECT_EQ(std::chrono::seconds(20), response.addresses[0].second);
+}
+
+TEST(VclDnsMessageTest, ParseCnameWithoutAddresses) {
+  ResponseBuilder builder(7, "www.example.com", VclDnsQtypeA);
+  builder.record(QuestionName, QtypeCname, 3600, ResponseBuilder::name("cdn.example.net"));
+  std::vector<uint8_t>& bytes = builder.bytes();
+
+  VclDnsResponse response;
+  ASSERT_TRUE(vclDnsParseResponse(bytes.data(), bytes.size(), VclDnsQtypeA, response));
+  EXPECT_TRUE(response.addresses.empty());
+}
+
+TEST(VclDnsMessageTest, ParseTruncatedRecords) {
+  ResponseBuilder builder(7, "example.com", VclDnsQtypeA);
+  builder.record(QuestionName, VclDnsQtypeA, 300, {192, 0, 2, 1});
+  const size_t second = builder.bytes().size();
+  builder.record(QuestionName, VclDnsQtypeA, 300, {192, 0, 2, 2});
+  std::vector<uint8_t>& bytes = builder.bytes();
+
+  // Cut in the second record's rdata, fixed fields and name. The first record is kept.
+  for (const size_t len : {bytes.size() - 1, second + 11, second + 1}) {
+    VclDnsResponse response;
+    ASSERT_TRUE(vclDnsParseResponse(bytes.data(), len, VclDnsQtypeA, response)) << len;
+    ASSERT_EQ(1, response.addresses.size()) << len;
+    EXPECT_EQ("192.0.2.1:0", response.addresses[0].first->asString());
+  }
+
+  // Cut in the question
+  VclDnsResponse response;
+  EXPECT_FALSE(vclDnsParseResponse(bytes.data(), QuestionName + 5, VclDnsQtypeA, response));
+  EXPECT_FALSE(vclDnsParseResponse(bytes.data(), VclDnsHeaderSize - 1, VclDnsQtypeA, response));
+}
+
+TEST(VclDnsMessageTest, ParseWrongRdlength) {
+  ResponseBuilder builder(7, "example.com", VclDnsQtypeA);
+  builder.record(QuestionName, VclDnsQtypeA, 300, {192, 0, 2});
+  builder.record(QuestionName, VclDnsQtypeA, 300, {192, 0, 2, 2});
+  std::vector<uint8_t>& bytes = builder.bytes();
+
+  VclDnsResponse response;
+  ASSERT_TRUE(vclDnsParseResponse(bytes.data(), bytes.size(), VclDnsQtypeA, response));
+  ASSERT_EQ(1, response.addresses.size());
+  EXPECT_EQ("192.0.2.2:0", response.addresses[0].first->asString());
+}
+
+TEST(VclDnsMessageTest, ParseMismatchedQtype) {
+  ResponseBuilder builder(7, "example.com", VclDnsQtypeAaaa);
+  builder.record(QuestionName, VclDnsQtypeA, 300, {192, 0, 2, 1});
+  std::vector<uint8_t>& bytes = builder.bytes();
+
+  VclDnsResponse response;
+  EXPECT_FALSE(vclDnsParseResponse(bytes.data(), bytes.size(), VclDnsQtypeA, response));
+  EXPECT_TRUE(response.addresses.empty());
+}
+
+TEST(VclDnsMessageTest, ParseNotAResponse) {
+  std::string query;
+  ASSERT_TRUE(vclDnsEncodeQuery(7, "example.com", VclDnsQtypeA, query));
+  VclDnsResponse response;
+  EXPECT_FALSE(vclDnsParseResponse(reinterpret_cast<const uint8_t*>(query.data()), query.size(),
+                                   VclDnsQtypeA, response));
+}
+
+TEST(VclDnsMessageTest, ParseRcode) {
+  ResponseBuilder builder(7, "example.com", VclDnsQtypeA, VclDnsRcodeNxDomain);
+  // Records of failed responses aren't looked at
+  builder.record(QuestionName, VclDnsQtypeA, 300, {192, 0, 2, 1});
+  std::vector<uint8_t>& bytes = builder.bytes();
+
+  VclDnsResponse response;
+  ASSERT_TRUE(vclDnsParseResponse(bytes.data(), bytes.size(), VclDnsQtypeA, response));
+  EXPECT_EQ(VclDnsRcodeNxDomain, response.rcode);
+  EXPECT_TRUE(response.addresses.empty());
+}
+
+TEST(VclDnsMessageTest, ParseTtlTopBit) {
+  ResponseBuilder builder(7, "example.com", VclDnsQtypeA);
+  builder.record(QuestionName, VclDnsQtypeA, 0x80000000, {192, 0, 2, 1});
+  std::vector<uint8_t>& bytes = builder.bytes();
+
+  VclDnsResponse response;
+  ASSERT_TRUE(vclDnsParseResponse(bytes.data(), bytes.size(), VclDnsQtypeA, response));
+  ASSERT_EQ(1, response.addresses.size());
+  EXPECT_EQ(std::chrono::seconds(0), response.addresses[0].second);
+}
+
+} // namespace
+} // namespace Vcl
+} // namespace Network
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,156 @@
+#include <sys/socket.h>
+
+#include "envoy/event/dispatcher.h"
+
+#include "source/common/network/address_impl.h"
+
+#include "test/test_common/utility.h"
+
+#include "vcl/replay/vppcom_standin.h"
+#include "vcl/vcl_interface.h"
+#include "vcl/vcl_io_handle.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Network {
+namespace Vcl {
+namespace {
+
+class VclStreamIoHandleTest : public testing::Test {
+protected:
+  static void SetUpTestSuite() {
+    // The test's thread is the main worker
+    if (vppcom_worker_index() == -1) {
+      vppcom_app_create("vcl_io_handle_test");
+    }
+  }
+};
+
+TEST_F(VclStreamIoHandleTest, PeekLeavesDataForRead) {
+  const uint32_t sh = vppcom_session_create(VPPCOM_PROTO_TCP, 1);
+  VclStreamIoHandle io_handle(sh);
+  VppcomStandin::addRxBytes(sh, 10);
+
+  char buf[16];
+  auto result = io_handle.recv(buf, 4, MSG_PEEK);
+  ASSERT_TRUE(result.ok());
+  EXPECT_EQ(4, result.return_value_);
+
+  Buffer::RawSlice slice{buf, sizeof(buf)};
+  result = io_handle.readv(sizeof(buf), &slice, 1);
+  ASSERT_TRUE(result.ok());
+  EXPECT_EQ(10, result.return_value_);
+}
+
+// A peek that finds nothing, or asks for nothing, must not make the next read look like eof
+TEST_F(VclStreamIoHandleTest, EmptyPeekIsNotEof) {
+  const uint32_t sh = vppcom_session_create(VPPCOM_PROTO_TCP, 1);
+  VclStreamIoHandle io_handle(sh);
+
+  char buf[16];
+  auto result = io_handle.recv(buf, sizeof(buf), MSG_PEEK);
+  ASSERT_FALSE(result.ok());
+  EXPECT_EQ(Api::IoError::IoErrorCode::Again, result.err_->getErrorCode());
+  io_handle.recv(buf, 0, MSG_PEEK);
+
+  VppcomStandin::addRxBytes(sh, 10);
+  Buffer::RawSlice slice{buf, sizeof(buf)};
+  result = io_handle.readv(sizeof(buf), &slice, 1);
+  ASSERT_TRUE(result.ok());
+  EXPECT_EQ(10, result.return_value_);
+}
+
+class VclDatagramIoHandleTest : public testing::Test {
+protected:
+  struct Worker {
+    int index;
+    Event::Dispatcher* dispatcher;
+  };
+
+  static void SetUpTestSuite() {
+    if (vppcom_worker_index() == -1) {
+      vppcom_app_create("vcl_io_handle_test");
+    }
+    main_index_ = vppcom_worker_index();
+    // Workers take turns on the test's thread. Their event loops are never freed, like those of
+    // envoy's workers, since vcl keeps its events on them until exit.
+    api_ = Api::createApiForTest().release();
+    for (Worker& wrk : workers_) {
+      vcl_interface_worker_register();
+      wrk.index = vppcom_worker_index();
+      wrk.dispatcher = api_->allocateDispatcher("vcl_worker").release();
+    }
+    vppcom_worker_index_set(main_index_);
+  }
+
+  void TearDown() override { vppcom_worker_index_set(main_index_); }
+
+  static int main_index_;
+  static Api::Api* api_;
+  static Worker workers_[2];
+};
+
+int VclDatagramIoHandleTest::main_index_;
+Api::Api* VclDatagramIoHandleTest::api_;
+VclDatagramIoHandleTest::Worker VclDatagramIoHandleTest::workers_[2];
+
+// Duplicates of a UDP listen socket do their io on a session bound on their own worker, which
+// they close there
+TEST_F(VclDatagramIoHandleTest, DuplicatesUseWorkerSessions) {
+  VclDatagramIoHandle io_handle(vppcom_session_create(VPPCOM_PROTO_UDP, 1));
+  auto address = std::make_shared<Envoy::Network::Address::Ipv4Instance>("127.0.0.1", 8080);
+  ASSERT_EQ(0, io_handle.bind(address).return_value_);
+  Envoy::Network::IoHandlePtr duplicates[2] = {io_handle.duplicate(), io_handle.duplicate()};
+
+  uint32_t wrk_sh[2];
+  for (int i = 0; i < 2; i++) {
+    vppcom_worker_index_set(workers_[i].index);
+    duplicates[i]->initializeFileEvent(
+        *workers_[i].dispatcher, [](uint32_t) {}, Event::FileTriggerType::Edge,
+        Event::FileReadyType::Read);
+    wrk_sh[i] = VppcomStandin::boundSh();
+    EXPECT_EQ(workers_[i].index, vppcom_session_worker(wrk_sh[i]));
+  }
+  EXPECT_NE(wrk_sh[0], wrk_sh[1]);
+
+  // Datagrams received on a worker's session are read by that worker's duplicate only
+  char buf[16];
+  Buffer::RawSlice slice{buf, sizeof(buf)};
+  Envoy::Network::IoHandle::RecvMsgOutput output(1, nullptr);
+  vppcom_worker_index_set(workers_[1].index);
+  VppcomStandin::addRxBytes(wrk_sh[1], 10);
+  vppcom_worker_index_set(workers_[0].index);
+  auto result = duplicates[0]->recvmsg(&slice, 1, 8080, output);
+  ASSERT_FALSE(result.ok());
+  EXPECT_EQ(Api::IoError::IoErrorCode::Again, result.err_->getErrorCode());
+
+  vppcom_worker_index_set(workers_[1].index);
+  result = duplicates[1]->recvmsg(&slice, 1, 8080, output);
+  ASSERT_TRUE(result.ok());
+  EXPECT_EQ(10, result.return_value_);
+  const uint64_t written = VppcomStandin::bytesWritten();
+  result = duplicates[1]->sendmsg(&slice, 1, 0, nullptr, *output.msg_[0].peer_address_);
+  ASSERT_TRUE(result.ok());
+  EXPECT_EQ(written + 16, VppcomStandin::bytesWritten());
+
+  duplicates[1]->resetFileEvents();
+  duplicates[1]->close();
+  EXPECT_EQ(VPPCOM_EBADFD, vppcom_session_attr(wrk_sh[1], VPPCOM_ATTR_GET_NREAD, nullptr, nullptr));
+  EXPECT_EQ(0, vppcom_session_attr(wrk_sh[0], VPPCOM_ATTR_GET_NREAD, nullptr, nullptr));
+
+  vppcom_worker_index_set(workers_[0].index);
+  duplicates[0]->resetFileEvents();
+  duplicates[0]->close();
+  EXPECT_EQ(VPPCOM_EBADFD, vppcom_session_attr(wrk_sh[0], VPPCOM_ATTR_GET_NREAD, nullptr, nullptr));
+
+  vppcom_worker_index_set(main_index_);
+  io_handle.close();
+}
+
+} // namespace
+} // namespace Vcl
+} // namespace Network
+} // namespace Extensions
+} // namespace Envoy
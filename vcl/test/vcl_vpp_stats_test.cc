@@ -0,0 +1,139 @@
+#include <fstream>
+
+#include "source/common/stats/isolated_store_impl.h"
+
+#include "test/test_common/environment.h"
+
+#include "vcl/vcl_vpp_stats.h"
+
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Network {
+namespace Vcl {
+namespace {
+
+class VclVppStatsTest : public testing::Test {
+protected:
+  VclVppStatsTest() : path_(TestEnvironment::temporaryPath("vpp_stats")), file_(path_) {}
+
+  void writeStats(const std::string& contents) {
+    std::ofstream out(path_, std::ios::trunc);
+    out << contents;
+  }
+
+  // Reads the stats file and publishes what was read, like a tick of VclVppStats.
+  void sample() {
+    std::vector<VppStat> stats;
+    ASSERT_TRUE(file_.read(prefixes_, stats));
+    publisher_.publish(stats);
+  }
+
+  uint64_t counter(const std::string& name) {
+    return store_.counterFromString("vcl.vpp." + name).value();
+  }
+
+  uint64_t gauge(const std::string& name) {
+    return store_.gaugeFromString("vcl.vpp." + name, Stats::Gauge::ImportMode::NeverImport)
+        .value();
+  }
+
+  const std::string path_;
+  VppStatsFile file_;
+  std::vector<std::string> prefixes_{"/err/tcp4-", "/sys/"};
+  Stats::IsolatedStoreImpl store_;
+  VppStatsPublisher publisher_{store_};
+};
+
+TEST(VclVppStatNameTest, Name) {
+  EXPECT_EQ("err.tcp4-output.no_buffer", vclVppStatName("/err/tcp4-output/no buffer"));
+  EXPECT_EQ("sys.vector_rate", vclVppStatName("/sys/vector_rate"));
+  EXPECT_EQ("err.session-queue.evt_q_full_", vclVppStatName("/err/session-queue/evt_q:full!"));
+  EXPECT_EQ("sys.num_worker_threads", vclVppStatName("sys/num_worker_threads"));
+}
+
+TEST_F(VclVppStatsTest, MissingFile) {
+  VppStatsFile missing(TestEnvironment::temporaryPath("vpp_stats_missing"));
+  std::vector<VppStat> stats;
+  EXPECT_FALSE(missing.read(prefixes_, stats));
+  EXPECT_TRUE(stats.empty());
+}
+
+TEST_F(VclVppStatsTest, ReadFiltersByPrefix) {
+  writeStats("/err/tcp4-output/no_buffer 5\n"
+             "/err/udp4-input/no_listener 7\n"
+             "/sys/vector_rate 3 gauge\n"
+             "/err/tcp4-input/malformed\n"
+             "\n");
+  std::vector<VppStat> stats;
+  ASSERT_TRUE(file_.read(prefixes_, stats));
+  ASSERT_EQ(2, stats.size());
+  EXPECT_EQ("/err/tcp4-output/no_buffer", stats[0].name);
+  EXPECT_EQ(5, stats[0].value);
+  EXPECT_FALSE(stats[0].gauge);
+  EXPECT_EQ("/sys/vector_rate", stats[1].name);
+  EXPECT_EQ(3, stats[1].value);
+  EXPECT_TRUE(stats[1].gauge);
+}
+
+TEST_F(VclVppStatsTest, FirstSampleIsBaseline) {
+  writeStats("/err/tcp4-output/no_buffer 100\n");
+  sample();
+  EXPECT_EQ(0, counter("err.tcp4-output.no_buffer"));
+}
+
+TEST_F(VclVppStatsTest, CountersAddDeltas) {
+  writeStats("/err/tcp4-output/no_buffer 100\n");
+  sample();
+  writeStats("/err/tcp4-output/no_buffer 130\n");
+  sample();
+  EXPECT_EQ(30, counter("err.tcp4-output.no_buffer"));
+  sample();
+  EXPECT_EQ(30, counter("err.tcp4-output.no_buffer"));
+  writeStats("/err/tcp4-output/no_buffer 131\n");
+  sample();
+  EXPECT_EQ(31, counter("err.tcp4-output.no_buffer"));
+}
+
+TEST_F(VclVppStatsTest, CountersResetOnRestart) {
+  writeStats("/err/tcp4-output/no_buffer 100\n");
+  sample();
+  writeStats("/err/tcp4-output/no_buffer 120\n");
+  sample();
+  // Vpp restarted and counted 5 since
+  writeStats("/err/tcp4-output/no_buffer 5\n");
+  sample();
+  EXPECT_EQ(25, counter("err.tcp4-output.no_buffer"));
+  writeStats("/err/tcp4-output/no_buffer 8\n");
+  sample();
+  EXPECT_EQ(28, counter("err.tcp4-output.no_buffer"));
+}
+
+TEST_F(VclVppStatsTest, CounterAppearingLaterIsBaseline) {
+  writeStats("/err/tcp4-output/no_buffer 1\n");
+  sample();
+  writeStats("/err/tcp4-output/no_buffer 1\n"
+             "/err/tcp4-input/no_listener 40\n");
+  sample();
+  EXPECT_EQ(0, counter("err.tcp4-input.no_listener"));
+  writeStats("/err/tcp4-output/no_buffer 1\n"
+             "/err/tcp4-input/no_listener 42\n");
+  sample();
+  EXPECT_EQ(2, counter("err.tcp4-input.no_listener"));
+}
+
+TEST_F(VclVppStatsTest, GaugesAreSet) {
+  writeStats("/sys/vector_rate 12 gauge\n");
+  sample();
+  EXPECT_EQ(12, gauge("sys.vector_rate"));
+  writeStats("/sys/vector_rate 4 gauge\n");
+  sample();
+  EXPECT_EQ(4, gauge("sys.vector_rate"));
+}
+
+} // namespace
+} // namespace Vcl
+} // namespace Network
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,135 @@
+#include "vcl/vcl_dns_message.h"
+
+#include <netinet/in.h>
+
+#include <cstring>
+#include <limits>
+
+#include "source/common/network/address_impl.h"
+
+#include "absl/strings/str_split.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Network {
+namespace Vcl {
+
+namespace {
+
+constexpr uint16_t QrFlag = 0x8000;
+constexpr uint16_t RdFlag = 0x0100;
+constexpr uint16_t QclassIn = 1;
+
+uint16_t read16(const uint8_t* p) { return static_cast<uint16_t>(p[0] << 8 | p[1]); }
+
+uint32_t read32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 |
+         static_cast<uint32_t>(p[2]) << 8 | p[3];
+}
+
+void append16(std::string& out, uint16_t v) {
+  out.push_back(static_cast<char>(v >> 8));
+  out.push_back(static_cast<char>(v & 0xff));
+}
+
+} // namespace
+
+bool vclDnsEncodeQuery(uint16_t id, const std::string& dns_name, uint16_t qtype,
+                       std::string& out) {
+  out.clear();
+  append16(out, id);
+  append16(out, RdFlag);
+  append16(out, 1);
+  append16(out, 0);
+  append16(out, 0);
+  append16(out, 0);
+  for (absl::string_view label : absl::StrSplit(dns_name, '.', absl::SkipEmpty())) {
+    if (label.size() > 63) {
+      return false;
+    }
+    out.push_back(static_cast<char>(label.size()));
+    out.append(label.data(), label.size());
+  }
+  out.push_back(0);
+  // Header, root label and the encoded name's 255 byte limit
+  if (out.size() - VclDnsHeaderSize > 255 || out.size() == VclDnsHeaderSize + 1) {
+    return false;
+  }
+  append16(out, qtype);
+  append16(out, QclassIn);
+  return true;
+}
+
+uint16_t vclDnsMessageId(const uint8_t* buf) { return read16(buf); }
+
+bool vclDnsSkipName(const uint8_t* buf, uint64_t len, uint64_t& offset) {
+  while (offset < len) {
+    const uint8_t label_len = buf[offset];
+    if (label_len == 0) {
+      offset++;
+      return true;
+    }
+    if ((label_len & 0xc0) == 0xc0) {
+      offset += 2;
+      return offset <= len;
+    }
+    if (label_len & 0xc0) {
+      return false;
+    }
+    offset += 1 + label_len;
+  }
+  return false;
+}
+
+bool vclDnsParseResponse(const uint8_t* buf, uint64_t len, uint16_t qtype,
+                         VclDnsResponse& response) {
+  if (len < VclDnsHeaderSize) {
+    return false;
+  }
+  const uint16_t flags = read16(buf + 2);
+  const uint16_t ancount = read16(buf + 6);
+  uint64_t offset = VclDnsHeaderSize;
+  // Must answer the single question asked
+  if (!(flags & QrFlag) || read16(buf + 4) != 1 || !vclDnsSkipName(buf, len, offset) ||
+      offset + 4 > len || read16(buf + offset) != qtype) {
+    return false;
+  }
+  offset += 4;
+
+  response.rcode = flags & 0xf;
+  response.addresses.clear();
+  for (uint16_t i = 0; response.rcode == VclDnsRcodeNoError && i < ancount; i++) {
+    if (!vclDnsSkipName(buf, len, offset) || offset + 10 > len) {
+      break;
+    }
+    const uint16_t type = read16(buf + offset);
+    const uint32_t ttl = read32(buf + offset + 4);
+    const uint16_t rdlength = read16(buf + offset + 8);
+    offset += 10;
+    if (offset + rdlength > len) {
+      break;
+    }
+    // TTLs with the top bit set are treated as 0, see RFC 2181
+    const std::chrono::seconds ttl_s(ttl > std::numeric_limits<int32_t>::max() ? 0 : ttl);
+    if (type == VclDnsQtypeA && qtype == VclDnsQtypeA && rdlength == 4) {
+      sockaddr_in sin{};
+      sin.sin_family = AF_INET;
+      memcpy(&sin.sin_addr, buf + offset, 4);
+      response.addresses.emplace_back(
+          std::make_shared<Envoy::Network::Address::Ipv4Instance>(&sin), ttl_s);
+    } else if (type == VclDnsQtypeAaaa && qtype == VclDnsQtypeAaaa && rdlength == 16) {
+      sockaddr_in6 sin6{};
+      sin6.sin6_family = AF_INET6;
+      memcpy(&sin6.sin6_addr, buf + offset, 16);
+      response.addresses.emplace_back(
+          std::make_shared<Envoy::Network::Address::Ipv6Instance>(sin6), ttl_s);
+    }
+    offset += rdlength;
+  }
+  return true;
+}
+
+} // namespace Vcl
+} // namespace Network
+} // namespace Extensions
+} // namespace Envoy
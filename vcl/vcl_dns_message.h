@@ -0,0 +1,50 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "envoy/network/address.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Network {
+namespace Vcl {
+
+constexpr uint64_t VclDnsHeaderSize = 12;
+// No EDNS, so responses are capped at 512 bytes. Larger ones come truncated.
+constexpr uint64_t VclDnsMaxResponseSize = 512;
+constexpr uint16_t VclDnsQtypeA = 1;
+constexpr uint16_t VclDnsQtypeAaaa = 28;
+constexpr uint16_t VclDnsRcodeNoError = 0;
+constexpr uint16_t VclDnsRcodeNxDomain = 3;
+
+struct VclDnsResponse {
+  uint16_t rcode{VclDnsRcodeNoError};
+  // Addresses of the query type asked for, with their TTLs
+  std::vector<std::pair<Envoy::Network::Address::InstanceConstSharedPtr, std::chrono::seconds>>
+      addresses;
+};
+
+// Builds a recursive query for dns_name, or returns false if the name can't be encoded.
+bool vclDnsEncodeQuery(uint16_t id, const std::string& dns_name, uint16_t qtype, std::string& out);
+
+// Id of the message in buf. Assumes at least a header's worth of bytes.
+uint16_t vclDnsMessageId(const uint8_t* buf);
+
+// Advances offset past a possibly compressed name. Returns false if the name runs past len or
+// uses a reserved label type. Pointers aren't followed, so loops can't trap the parser.
+bool vclDnsSkipName(const uint8_t* buf, uint64_t len, uint64_t& offset);
+
+// Parses a response to a single question of type qtype, or returns false if buf isn't one.
+// Records of other types, e.g., the CNAMEs leading to the addresses, are skipped. Parsing stops at
+// the first truncated record, keeping the addresses before it.
+bool vclDnsParseResponse(const uint8_t* buf, uint64_t len, uint16_t qtype,
+                         VclDnsResponse& response);
+
+} // namespace Vcl
+} // namespace Network
+} // namespace Extensions
+} // namespace Envoy
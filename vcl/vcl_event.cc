@@ -2,27 +2,86 @@
 
 #include "source/common/runtime/runtime_features.h"
 
+#include "vcl/vcl_interface.h"
+#include "vcl/vcl_trace.h"
+
 namespace Envoy {
 namespace Extensions {
 namespace Network {
 namespace Vcl {
 
-VclEvent::VclEvent(Dispatcher& dispatcher, VclIoHandle& io_handle, FileReadyCb cb)
-    : cb_(cb), io_handle_(io_handle) {
-  activation_cb_ = dispatcher.createSchedulableCallback([this]() {
-    ASSERT(injected_activation_events_ != 0);
-    mergeInjectedEventsAndRunCb(0);
-  });
+void VclReadyList::initialize(Dispatcher& dispatcher) {
+  ASSERT(drain_cb_ == nullptr);
+  dispatcher_ = &dispatcher;
+  drain_cb_ = dispatcher.createSchedulableCallback([this]() { drain(); });
 }
 
-VclEvent::~VclEvent() {
-  // Worker listeners are valid only as long as the event is valid
-  if (io_handle_.isWrkListener()) {
-    auto parentListener = io_handle_.getParentListener();
-    if (parentListener)
-      parentListener->clearChildWrkListener();
-    io_handle_.close();
+void VclReadyList::add(VclIoHandle& io_handle, uint32_t events) {
+  if (io_handle.ready_index_ < 0) {
+    io_handle.ready_index_ = static_cast<int32_t>(handles_.size());
+    handles_.push_back(&io_handle);
+  }
+  io_handle.ready_events_ |= events;
+}
+
+void VclReadyList::remove(VclIoHandle& io_handle) {
+  if (io_handle.ready_index_ < 0) {
+    return;
+  }
+  ASSERT(handles_[io_handle.ready_index_] == &io_handle);
+  handles_[io_handle.ready_index_] = nullptr;
+  io_handle.ready_index_ = -1;
+  io_handle.ready_events_ = 0;
+}
+
+void VclReadyList::scheduleDrain() {
+  ASSERT(drain_cb_ != nullptr);
+  if (!drain_cb_->enabled()) {
+    drain_cb_->scheduleCallbackNextIteration();
+  }
+}
+
+void VclReadyList::drain() {
+  // Only deliver to handles queued before this pass. Callbacks may queue new events, including on
+  // their own handle, and those run on the next iteration.
+  const size_t n_handles = handles_.size();
+  const MonotonicTime now = dispatcher_ ? dispatcher_->approximateMonotonicTime() : MonotonicTime();
+  for (size_t i = 0; i < n_handles; i++) {
+    VclIoHandle* vcl_handle = handles_[i];
+    if (vcl_handle == nullptr) {
+      continue;
+    }
+    handles_[i] = nullptr;
+    uint32_t events = vcl_handle->ready_events_;
+    vcl_handle->ready_events_ = 0;
+    vcl_handle->ready_index_ = -1;
+
+    // session closed due to some recently processed event
+    if (!vcl_handle->isOpen() || events == 0) {
+      continue;
+    }
+
+    VCL_TRACE(Deliver, vcl_handle->sh(), events, 0);
+    vcl_handle->last_event_ = now;
+    vcl_handle->cb(events);
   }
+
+  handles_.erase(handles_.begin(), handles_.begin() + n_handles);
+  for (size_t i = 0; i < handles_.size(); i++) {
+    if (handles_[i] != nullptr) {
+      handles_[i]->ready_index_ = static_cast<int32_t>(i);
+    }
+  }
+  if (!handles_.empty()) {
+    scheduleDrain();
+  }
+}
+
+VclEvent::VclEvent(VclIoHandle& io_handle) : io_handle_(io_handle) {}
+
+VclEvent::~VclEvent() {
+  // Pending activations are dropped along with the event, as libevent does.
+  vcl_ready_list(vppcom_worker_index()).remove(io_handle_);
 }
 
 void VclEvent::activate(uint32_t events) {
@@ -31,31 +90,16 @@ void VclEvent::activate(uint32_t events) {
   // Only supported event types are set.
   ASSERT((events & (FileReadyType::Read | FileReadyType::Write | FileReadyType::Closed)) == events);
 
-  cb_(events);
-
-  // Schedule the activation callback so it runs as part of the next loop iteration if it is not
-  // already scheduled.
-  if (injected_activation_events_ == 0) {
-    ASSERT(!activation_cb_->enabled());
-    activation_cb_->scheduleCallbackNextIteration();
-  }
-  ASSERT(activation_cb_->enabled());
-
-  // Merge new events with pending injected events.
-  injected_activation_events_ |= events;
+  // Merge with pending events for the handle and deliver them as part of the next loop iteration,
+  // or earlier if mq events are processed before that.
+  VCL_TRACE(Activate, io_handle_.sh(), events, 0);
+  VclReadyList& ready_list = vcl_ready_list(vppcom_worker_index());
+  ready_list.add(io_handle_, events);
+  ready_list.scheduleDrain();
 }
 
 void VclEvent::setEnabled(uint32_t events) { io_handle_.updateEvents(events); }
 
-void VclEvent::mergeInjectedEventsAndRunCb(uint32_t events) {
-  if (injected_activation_events_ != 0) {
-    events |= injected_activation_events_;
-    injected_activation_events_ = 0;
-    activation_cb_->cancel();
-  }
-  cb_(events);
-}
-
 void VclEvent::unregisterEventIfEmulatedEdge(uint32_t) {}
 
 void VclEvent::registerEventIfEmulatedEdge(uint32_t) {}
@@ -63,4 +107,4 @@ void VclEvent::registerEventIfEmulatedEdge(uint32_t) {}
 } // namespace Vcl
 } // namespace Network
 } // namespace Extensions
-} // namespace Envoy
\ No newline at end of file
+} // namespace Envoy
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <vector>
 
 #include "envoy/event/file_event.h"
 
@@ -17,9 +18,32 @@ namespace Vcl {
 using namespace Envoy::Event;
 using namespace Envoy::Network;
 
+// Per worker list of io handles with pending FileReadyType events. Both events injected through
+// activate() and events reported by VPP are merged per handle and delivered once per drain.
+class VclReadyList {
+public:
+  void initialize(Dispatcher& dispatcher);
+  bool initialized() const { return drain_cb_ != nullptr; }
+
+  // Merges events into the handle's pending events and queues the handle if not already queued.
+  void add(VclIoHandle& io_handle, uint32_t events);
+  // Drops the handle and its pending events, if any.
+  void remove(VclIoHandle& io_handle);
+  // Schedules a drain as part of the next loop iteration if not already scheduled.
+  void scheduleDrain();
+  // Runs callbacks for all handles queued before the call. Handles queued by those callbacks are
+  // delivered on the next iteration.
+  void drain();
+
+private:
+  std::vector<VclIoHandle*> handles_;
+  SchedulableCallbackPtr drain_cb_;
+  Dispatcher* dispatcher_{nullptr};
+};
+
 class VclEvent : public FileEvent {
 public:
-  VclEvent(Dispatcher& dispatcher, VclIoHandle& io_handle, FileReadyCb cb);
+  explicit VclEvent(VclIoHandle& io_handle);
   ~VclEvent() override;
 
   // Event::FileEvent
@@ -29,17 +53,9 @@ public:
   void registerEventIfEmulatedEdge(uint32_t event) override;
 
 private:
-  // void assignEvents(uint32_t events, event_base* base);
-  void mergeInjectedEventsAndRunCb(uint32_t events);
-
-  FileReadyCb cb_;
+  // Handle whose callback runs. For stream handles that turned into listeners, that's the listener
+  // they delegate to, not the handle owning the event.
   VclIoHandle& io_handle_;
-
-  // Injected FileReadyType events that were scheduled by recent calls to activate() and are pending
-  // delivery.
-  uint32_t injected_activation_events_{};
-  // Used to schedule delayed event activation. Armed iff pending_activation_events_ != 0.
-  SchedulableCallbackPtr activation_cb_;
 };
 
 } // namespace Vcl
@@ -1,28 +1,73 @@
 #include "vcl/vcl_interface.h"
 
-#include "vcl/vcl_socket_interface.pb.h"
+#include <map>
+#include <sstream>
 
+#include "envoy/api/api.h"
+
+#include "source/common/event/dispatcher_impl.h"
+#include "source/common/http/headers.h"
+#include "source/common/http/utility.h"
 #include "source/common/network/address_impl.h"
+#include "source/common/protobuf/utility.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/synchronization/mutex.h"
+#include "event2/watch.h"
 
+#include "vcl/vcl_event.h"
 #include "vcl/vcl_io_handle.h"
+#include "vcl/vcl_trace.h"
 
 namespace Envoy {
 namespace Extensions {
 namespace Network {
 namespace Vcl {
 
+static constexpr uint32_t DefaultSegmentStatsIntervalMs = 10000;
+static constexpr std::chrono::milliseconds IoErrorsInterval{1000};
 static uint32_t epoll_handles[128];
-static std::mutex wrk_lock;
-static absl::flat_hash_map<int, Envoy::Event::FileEventPtr> mq_events_;
+static VclReadyList ready_lists[128];
+// Event loops of the workers, for posts from other threads. Cleared as workers shut down.
+static absl::Mutex worker_dispatchers_lock;
+static Envoy::Event::Dispatcher* worker_dispatchers[128] ABSL_GUARDED_BY(worker_dispatchers_lock);
+static std::vector<VclIoHandle*> worker_sessions[128];
+// Indexed by vcl worker index, so each worker only ever touches its own slot.
+static Envoy::Event::FileEventPtr mq_events_[128];
+// Watchers polling vcl epoll from the worker's event loop. Freed with the loop's event base.
+static evwatch* check_watchers[128];
+// By port of the TLS listeners vpp terminates. Written at bootstrap, before workers start.
+static absl::flat_hash_map<uint16_t, VclTlsListener> tls_listeners;
+static absl::flat_hash_set<uint16_t> zero_copy_ports;
 
 uint32_t& vcl_epoll_handle(uint32_t wrk_index) { return epoll_handles[wrk_index]; }
 
-static void onMqSocketEvents(uint32_t flags) {
-  ASSERT((flags & (Event::FileReadyType::Read | Event::FileReadyType::Write)));
-  auto wrk_index = vppcom_worker_index();
-  VCL_LOG("events on worker %u", wrk_index);
+VclReadyList& vcl_ready_list(uint32_t wrk_index) { return ready_lists[wrk_index]; }
+
+void vclWorkerPost(uint32_t wrk_index, Event::PostCb cb) {
+  absl::MutexLock lock(&worker_dispatchers_lock);
+  if (worker_dispatchers[wrk_index] != nullptr) {
+    worker_dispatchers[wrk_index]->post(std::move(cb));
+  }
+}
+
+std::vector<VclIoHandle*>& vcl_worker_sessions(uint32_t wrk_index) {
+  return worker_sessions[wrk_index];
+}
+
+const VclTlsListener* vcl_tls_listener(uint16_t port) {
+  auto it = tls_listeners.find(port);
+  return it == tls_listeners.end() ? nullptr : &it->second;
+}
+
+bool vcl_zero_copy_port(uint16_t port) { return zero_copy_ports.contains(port); }
+
+// Moves events reported by vcl epoll to the worker's ready list and delivers them.
+static void vclPollEvents(uint32_t wrk_index, uint32_t flags) {
   struct epoll_event events[128];
   int max_events = 128, n_events;
+  VclReadyList& ready_list = ready_lists[wrk_index];
 
   while (max_events > 0) {
     n_events = vppcom_epoll_wait(epoll_handles[wrk_index], events, max_events, 0);
@@ -30,17 +75,11 @@ static void onMqSocketEvents(uint32_t flags) {
       break;
     }
     max_events -= n_events;
-    VCL_LOG("had %u events", n_events);
+    VCL_TRACE(MqEvents, VCL_INVALID_SH, flags, n_events);
 
     for (int i = 0; i < n_events; i++) {
+      // Worker listen sessions are registered with their listener's handle
       VclIoHandle* vcl_handle = reinterpret_cast<VclIoHandle*>(events[i].data.u64);
-      if (vcl_handle->isWrkListener()) {
-        vcl_handle = vcl_handle->getParentListener();
-      }
-
-      // session closed due to some recently processed event
-      if (!vcl_handle->isOpen())
-        continue;
 
       uint32_t evts = 0;
       if (events[i].events & EPOLLIN) {
@@ -50,42 +89,92 @@ static void onMqSocketEvents(uint32_t flags) {
         evts |= Event::FileReadyType::Write;
       }
       if (events[i].events & (EPOLLERR | EPOLLHUP)) {
-        RELEASE_ASSERT(vcl_handle->isOpen(), fmt::format ("handle 0x{:x} should be open", vcl_handle->sh()));
         evts |= Event::FileReadyType::Closed;
       }
 
-      VCL_LOG("got event on vcl handle fd %u sh %x events %x", vcl_handle->fdDoNotUse(),
-              vcl_handle->sh(), evts);
-      vcl_handle->cb(evts);
-      VCL_LOG("done with event\n");
+      VCL_TRACE(EpollEvent, vcl_handle->sh(), events[i].events, 0);
+      ready_list.add(*vcl_handle, evts);
     }
   }
+
+  // Deliver vpp events merged with injected ones in one pass
+  ready_list.drain();
+}
+
+static void onMqSocketEvents(uint32_t flags) {
+  ASSERT((flags & (Event::FileReadyType::Read | Event::FileReadyType::Write)));
+  auto wrk_index = vppcom_worker_index();
+  // Loop check watchers already polled vcl on this wakeup
+  if (check_watchers[wrk_index] != nullptr) {
+    return;
+  }
+  vclPollEvents(wrk_index, flags);
+}
+
+static void onLoopCheck(evwatch*, const evwatch_check_cb_info*, void* arg) {
+  vclPollEvents(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(arg)), 0);
 }
 
 void vcl_interface_worker_register() {
-  wrk_lock.lock();
+  // VCL serializes worker pool allocation internally and each worker attaches to vpp over its own
+  // api socket, so workers can register in parallel.
   vppcom_worker_register();
-  wrk_lock.unlock();
   int epoll_handle = vppcom_epoll_create();
   if (epoll_handle < 0) {
-    VCL_LOG("failed to create epoll handle");
+    ENVOY_LOG_MISC(critical, "vcl worker {}: failed to create epoll handle", vppcom_worker_index());
     exit(1);
   }
   epoll_handles[vppcom_worker_index()] = epoll_handle;
-  VCL_LOG("registered worker %u and epoll handle %u mq fd %d", vppcom_worker_index(), epoll_handle,
-          vppcom_mq_epoll_fd());
+  // Vpp created the worker's fifo segments when it registered
+  vclPrefaultSegments();
+  ENVOY_LOG_MISC(debug, "registered vcl worker {} epoll handle {} mq fd {}", vppcom_worker_index(),
+                 epoll_handle, vppcom_mq_epoll_fd());
 }
 
 void vcl_interface_register_epoll_event(Envoy::Event::Dispatcher& dispatcher) {
-  if (mq_events_.find(vppcom_worker_index()) != mq_events_.end()) {
+  RELEASE_ASSERT(vppcom_worker_index() != -1, "");
+  if (mq_events_[vppcom_worker_index()]) {
     return;
   }
-  RELEASE_ASSERT(vppcom_worker_index() != -1, "");
+  ready_lists[vppcom_worker_index()].initialize(dispatcher);
+  const uint32_t wrk_index = vppcom_worker_index();
+  {
+    absl::MutexLock lock(&worker_dispatchers_lock);
+    worker_dispatchers[wrk_index] = &dispatcher;
+  }
+  // Vcl epoll is polled on every iteration of the dispatcher's event loop, right after it wakes
+  // up and before timers, deferred deletes and other events run. The mq fd event stays
+  // registered, so the loop still blocks on vpp's mqs and the kernel's fds together.
+  auto* dispatcher_impl = dynamic_cast<Envoy::Event::DispatcherImpl*>(&dispatcher);
+  if (dispatcher_impl != nullptr) {
+    check_watchers[vppcom_worker_index()] =
+        evwatch_check_new(&dispatcher_impl->base(), onLoopCheck,
+                          reinterpret_cast<void*>(static_cast<uintptr_t>(vppcom_worker_index())));
+  }
   mq_events_[vppcom_worker_index()] = dispatcher.createFileEvent(
       vppcom_mq_epoll_fd(), [](uint32_t events) -> void { onMqSocketEvents(events); },
       Event::FileTriggerType::Edge, Event::FileReadyType::Read | Event::FileReadyType::Write);
 }
 
+// Sessions get the handle specialized for their protocol. Stream handles become listeners once
+// listened on.
+static Envoy::Network::IoHandlePtr vclSocket(Envoy::Network::Socket::Type socket_type) {
+  if (socket_type == Envoy::Network::Socket::Type::Stream) {
+    auto sh = vppcom_session_create(VPPCOM_PROTO_TCP, 1);
+    if (sh < 0) {
+      vcl_segment_alloc_failed();
+      return nullptr;
+    }
+    return std::make_unique<VclStreamIoHandle>(static_cast<uint32_t>(sh));
+  }
+  auto sh = vppcom_session_create(VPPCOM_PROTO_UDP, 1);
+  if (sh < 0) {
+    vcl_segment_alloc_failed();
+    return nullptr;
+  }
+  return std::make_unique<VclDatagramIoHandle>(static_cast<uint32_t>(sh));
+}
+
 Envoy::Network::IoHandlePtr VclSocketInterface::socket(Envoy::Network::Socket::Type socket_type,
                                                        Envoy::Network::Address::Type addr_type,
                                                        Envoy::Network::Address::IpVersion,
@@ -93,16 +182,10 @@ Envoy::Network::IoHandlePtr VclSocketInterface::socket(Envoy::Network::Socket::T
   if (vppcom_worker_index() == -1) {
     vcl_interface_worker_register();
   }
-  VCL_LOG("trying to create socket1 epoll fd %d", vppcom_mq_epoll_fd());
   if (addr_type == Envoy::Network::Address::Type::Pipe) {
     return nullptr;
   }
-  auto sh = vppcom_session_create(
-      socket_type == Envoy::Network::Socket::Type::Stream ? VPPCOM_PROTO_TCP : VPPCOM_PROTO_UDP, 1);
-  if (sh < 0) {
-    return nullptr;
-  }
-  return std::make_unique<VclIoHandle>(static_cast<uint32_t>(sh), 1 << 23);
+  return vclSocket(socket_type);
 }
 
 Envoy::Network::IoHandlePtr
@@ -111,16 +194,10 @@ VclSocketInterface::socket(Envoy::Network::Socket::Type socket_type,
   if (vppcom_worker_index() == -1) {
     vcl_interface_worker_register();
   }
-  VCL_LOG("trying to create socket2 epoll fd %d", vppcom_mq_epoll_fd());
   if (addr->type() == Envoy::Network::Address::Type::Pipe) {
     return nullptr;
   }
-  auto sh = vppcom_session_create(
-      socket_type == Envoy::Network::Socket::Type::Stream ? VPPCOM_PROTO_TCP : VPPCOM_PROTO_UDP, 1);
-  if (sh < 0) {
-    return nullptr;
-  }
-  return std::make_unique<VclIoHandle>(static_cast<uint32_t>(sh), 1 << 23);
+  return vclSocket(socket_type);
 }
 
 bool VclSocketInterface::ipFamilySupported(int domain) {
@@ -129,19 +206,278 @@ bool VclSocketInterface::ipFamilySupported(int domain) {
 };
 
 VclSocketInterfaceExtension::VclSocketInterfaceExtension(
-    Envoy::Network::SocketInterface& sock_interface)
-    : Envoy::Network::SocketInterfaceExtension(sock_interface) {}
+    Envoy::Network::SocketInterface& sock_interface,
+    Server::Configuration::ServerFactoryContext& ctx,
+    const envoy::extensions::network::socket_interface::v3::VclSocketInterface& config)
+    : Envoy::Network::SocketInterfaceExtension(sock_interface), time_source_(ctx.timeSource()),
+      stats_({ALL_VCL_BOOTSTRAP_STATS(POOL_COUNTER_PREFIX(ctx.scope(), "vcl."),
+                                      POOL_GAUGE_PREFIX(ctx.scope(), "vcl."),
+                                      POOL_HISTOGRAM_PREFIX(ctx.scope(), "vcl."))}),
+      slot_(ctx.threadLocal().allocateSlot()),
+      main_dispatcher_(ctx.mainThreadDispatcher()),
+      scope_(ctx.scope()),
+      segment_stats_interval_(config.fifo_segments().stats_interval_ms()
+                                  ? config.fifo_segments().stats_interval_ms()
+                                  : DefaultSegmentStatsIntervalMs) {
+  if (config.has_worker_placement()) {
+    placement_ = std::make_unique<VclWorkerPlacement>(config.worker_placement());
+  }
+  if (config.trace().records_per_worker()) {
+    vclTraceSetRingSize(config.trace().records_per_worker());
+  }
+  vclTraceEnable(config.trace().enabled());
+  vclTraceRegisterFatalHandler();
+  vclTraceCalibrate();
+  if (!config.trace().capture_path().empty()) {
+    vclCaptureStart(config.trace().capture_path());
+  }
+  if (config.has_vpp_stats()) {
+    vpp_stats_ = std::make_unique<VclVppStats>(config.vpp_stats(), ctx.api(),
+                                               ctx.mainThreadDispatcher(), ctx.scope());
+  }
+  registerAdminHandlers(ctx.admin());
+}
+
+void VclSocketInterfaceExtension::registerAdminHandlers(Server::Admin& admin) {
+  admin.addHandler(
+      "/vcl/sessions",
+      "vcl sessions, listeners and fifo usage per worker, as of the last complete dump",
+      [this](absl::string_view, Http::ResponseHeaderMap& response_headers,
+             Buffer::Instance& response, Server::AdminStream&) -> Http::Code {
+        response_headers.setReferenceContentType(Http::Headers::get().ContentTypeValues.Text);
+        // The main thread doesn't wait for workers to dump, so each request returns the last
+        // complete dump and starts the next
+        const bool dumped = sessions_dump_time_ != MonotonicTime();
+        if (dumped) {
+          response.add(fmt::format(
+              "dump started {}ms ago\n",
+              std::chrono::duration_cast<std::chrono::milliseconds>(
+                  time_source_.monotonicTime() - sessions_dump_time_)
+                  .count()));
+          response.add(sessions_dump_);
+        } else {
+          response.add("workers are dumping their sessions, retry\n");
+        }
+        refreshSessionsDump();
+        return dumped ? Http::Code::OK : Http::Code::ServiceUnavailable;
+      },
+      false, false);
+  admin.addHandler(
+      "/vcl/trace", "dump vcl trace records of all workers",
+      [](absl::string_view, Http::ResponseHeaderMap& response_headers, Buffer::Instance& response,
+         Server::AdminStream&) -> Http::Code {
+        std::ostringstream os;
+        vclTraceDumpAll(os);
+        response_headers.setReferenceContentType(Http::Headers::get().ContentTypeValues.Text);
+        response.add(os.str());
+        return Http::Code::OK;
+      },
+      false, false);
+  admin.addHandler(
+      "/vcl/trace_enable", "enable or disable vcl tracing (?enable=true|false)",
+      [](absl::string_view path_and_query, Http::ResponseHeaderMap&, Buffer::Instance& response,
+         Server::AdminStream&) -> Http::Code {
+        auto params = Http::Utility::parseAndDecodeQueryString(path_and_query);
+        auto it = params.find("enable");
+        if (it == params.end() || (it->second != "true" && it->second != "false")) {
+          response.add("usage: /vcl/trace_enable?enable=true|false\n");
+          return Http::Code::BadRequest;
+        }
+        vclTraceEnable(it->second == "true");
+        response.add(fmt::format("vcl tracing {}\n", vclTraceRingEnabled() ? "enabled" : "disabled"));
+        return Http::Code::OK;
+      },
+      false, true);
+  admin.addHandler(
+      "/vcl/capture", "start or stop capturing vcl trace records to files (?path=<prefix>|stop)",
+      [this](absl::string_view path_and_query, Http::ResponseHeaderMap&,
+             Buffer::Instance& response, Server::AdminStream&) -> Http::Code {
+        auto params = Http::Utility::parseAndDecodeQueryString(path_and_query);
+        if (params.find("stop") != params.end()) {
+          vclCaptureStop();
+          // Workers write out and close their files
+          slot_->runOnAllThreads([](OptRef<ThreadLocal::ThreadLocalObject>) {
+            int wrk_index = vppcom_worker_index();
+            if (wrk_index >= 0) {
+              vclCaptureFlush(wrk_index);
+            }
+          });
+          response.add("vcl capture stopped\n");
+          return Http::Code::OK;
+        }
+        auto it = params.find("path");
+        if (it == params.end() || it->second.empty() || vclCaptureEnabled()) {
+          response.add("usage: /vcl/capture?path=<prefix> or /vcl/capture?stop, one capture at a "
+                       "time\n");
+          return Http::Code::BadRequest;
+        }
+        vclCaptureStart(it->second);
+        response.add(fmt::format("vcl capture to {}.<worker>\n", it->second));
+        return Http::Code::OK;
+      },
+      false, true);
+}
+
+void VclSocketInterfaceExtension::onServerInitialized() {
+  // Register the main thread and all workers with vcl before listeners are added to workers, so
+  // first requests don't pay for registration. Each thread registers itself, in parallel.
+  const MonotonicTime start = time_source_.monotonicTime();
+  slot_->set([this](Event::Dispatcher& dispatcher) -> ThreadLocal::ThreadLocalObjectSharedPtr {
+    registerWorker(dispatcher);
+    return std::make_shared<VclWorkerRegistration>();
+  });
+  slot_->runOnAllThreads([](OptRef<ThreadLocal::ThreadLocalObject>) {},
+                         [this, start]() {
+                           stats_.workers_register_time_ms_.set(
+                               std::chrono::duration_cast<std::chrono::milliseconds>(
+                                   time_source_.monotonicTime() - start)
+                                   .count());
+                         });
+  segment_stats_ = std::make_unique<VclSegmentStats>(main_dispatcher_, scope_, *slot_,
+                                                     segment_stats_interval_);
+  io_errors_timer_ = main_dispatcher_.createTimer([this]() { publishIoErrors(); });
+  io_errors_timer_->enableTimer(IoErrorsInterval);
+}
+
+void VclSocketInterfaceExtension::publishIoErrors() {
+  for (uint32_t err = 1; err < VclMaxIoErrno; err++) {
+    const uint64_t total = vcl_io_errors(err);
+    auto it = io_errors_.find(err);
+    if (it == io_errors_.end()) {
+      if (!total) {
+        continue;
+      }
+      Stats::Counter& counter =
+          scope_.counterFromString(fmt::format("vcl.io_errors.{}", vclIoErrorName(err)));
+      it = io_errors_.emplace(err, std::make_pair(&counter, 0)).first;
+    }
+    it->second.first->add(total - it->second.second);
+    it->second.second = total;
+  }
+  io_errors_timer_->enableTimer(IoErrorsInterval);
+}
+
+VclWorkerRegistration::~VclWorkerRegistration() {
+  const int wrk_index = vppcom_worker_index();
+  if (wrk_index >= 0) {
+    absl::MutexLock lock(&worker_dispatchers_lock);
+    worker_dispatchers[wrk_index] = nullptr;
+  }
+}
+
+VclSocketInterfaceExtension::~VclSocketInterfaceExtension() {
+  // Workers have exited by now, so their capture buffers can be written out from here
+  vclCaptureStop();
+  vclCaptureFlushAll();
+}
+
+void VclSocketInterfaceExtension::refreshSessionsDump() {
+  if (sessions_dump_pending_) {
+    return;
+  }
+  sessions_dump_pending_ = true;
+  // Each worker dumps its own sessions between two event loop iterations, so workers never stop
+  // and sessions are only touched by their owners
+  struct Dumps {
+    absl::Mutex mutex;
+    std::map<uint32_t, std::string> dumps ABSL_GUARDED_BY(mutex);
+  };
+  auto dumps = std::make_shared<Dumps>();
+  const MonotonicTime now = time_source_.monotonicTime();
+
+  slot_->runOnAllThreads(
+      [dumps, now](OptRef<ThreadLocal::ThreadLocalObject>) {
+        int wrk_index = vppcom_worker_index();
+        if (wrk_index < 0) {
+          return;
+        }
+        std::ostringstream os;
+        vclDumpWorkerSessions(wrk_index, now, os);
+        absl::MutexLock lock(&dumps->mutex);
+        dumps->dumps[wrk_index] = os.str();
+      },
+      [this, dumps, now]() {
+        std::string output;
+        absl::MutexLock lock(&dumps->mutex);
+        for (const auto& dump : dumps->dumps) {
+          output += dump.second;
+        }
+        sessions_dump_ = std::move(output);
+        sessions_dump_time_ = now;
+        sessions_dump_pending_ = false;
+      });
+}
+
+void VclSocketInterfaceExtension::registerWorker(Event::Dispatcher& dispatcher) {
+  const MonotonicTime start = time_source_.monotonicTime();
+  if (vppcom_worker_index() == -1) {
+    vcl_interface_worker_register();
+    if (placement_) {
+      placement_->pinWorker(vppcom_worker_index());
+    }
+  }
+  vcl_interface_register_epoll_event(dispatcher);
+  stats_.worker_register_time_us_.recordValue(
+      std::chrono::duration_cast<std::chrono::microseconds>(time_source_.monotonicTime() - start)
+          .count());
+  stats_.workers_registered_.inc();
+}
+
+static void addTlsListeners(
+    const envoy::extensions::network::socket_interface::v3::VclSocketInterface& config,
+    Api::Api& api) {
+  for (const auto& tls_listener : config.tls_listeners()) {
+    if (!tls_listener.port() || tls_listener.port() > 65535) {
+      throw EnvoyException(fmt::format("vcl: invalid tls listener port {}", tls_listener.port()));
+    }
+    std::string cert = api.fileSystem().fileReadToEnd(tls_listener.certificate_chain_path());
+    std::string key = api.fileSystem().fileReadToEnd(tls_listener.private_key_path());
+    vppcom_cert_key_pair_t ckpair;
+    ckpair.cert = cert.data();
+    ckpair.key = key.data();
+    ckpair.cert_len = cert.size();
+    ckpair.key_len = key.size();
+    int rv = vppcom_add_cert_key_pair(&ckpair);
+    if (rv < 0) {
+      throw EnvoyException(fmt::format("vcl: failed to add tls cert/key pair for port {}: {}",
+                                       tls_listener.port(), rv));
+    }
+    tls_listeners[tls_listener.port()] = {
+        static_cast<uint8_t>(tls_listener.quic() ? VPPCOM_PROTO_QUIC : VPPCOM_PROTO_TLS),
+        static_cast<uint32_t>(rv)};
+  }
+}
 
 Server::BootstrapExtensionPtr
-VclSocketInterface::createBootstrapExtension(const Protobuf::Message&,
+VclSocketInterface::createBootstrapExtension(const Protobuf::Message& config,
                                              Server::Configuration::ServerFactoryContext& ctx) {
-  vppcom_app_create("envoy");
+  const auto& vcl_config = MessageUtil::downcastAndValidate<
+      const envoy::extensions::network::socket_interface::v3::VclSocketInterface&>(
+      config, ctx.messageValidationContext().staticValidationVisitor());
+  for (uint32_t port : vcl_config.zero_copy_ports()) {
+    zero_copy_ports.insert(port);
+  }
+
+  // Vcl reads the api socket from the environment after its config file
+  const auto& vpp_instance = vcl_config.vpp_instance();
+  if (!vpp_instance.api_socket_name().empty()) {
+    setenv(VPPCOM_ENV_VPP_API_SOCKET, vpp_instance.api_socket_name().c_str(), 1);
+  }
+  if (vcl_config.has_fifo_segments()) {
+    vclApplyFifoSegmentsConfig(vcl_config.fifo_segments(), ctx.api().fileSystem());
+  }
+  const std::string app_name =
+      vpp_instance.app_name().empty() ? "envoy" : vpp_instance.app_name();
+  const int rv = vppcom_app_create(app_name.c_str());
+  vclRemoveFifoSegmentsConfig();
+  if (rv != VPPCOM_OK) {
+    throw EnvoyException(fmt::format("vcl: failed to attach app {} to vpp", app_name));
+  }
+  vclPrefaultSegments();
   epoll_handles[vppcom_worker_index()] = vppcom_epoll_create();
+  addTlsListeners(vcl_config, ctx.api());
 
-  ctx.dispatcher().createFileEvent(
-      vppcom_mq_epoll_fd(), [](uint32_t events) -> void { onMqSocketEvents(events); },
-      Event::FileTriggerType::Edge, Event::FileReadyType::Read | Event::FileReadyType::Write);
-  return std::make_unique<VclSocketInterfaceExtension>(*this);
+  return std::make_unique<VclSocketInterfaceExtension>(*this, ctx, vcl_config);
 }
 
 ProtobufTypes::MessagePtr VclSocketInterface::createEmptyConfigProto() {
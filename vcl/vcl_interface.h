@@ -1,9 +1,23 @@
 #pragma once
 
+#include <atomic>
+#include <vector>
+
+#include "envoy/common/time.h"
 #include "envoy/network/socket.h"
+#include "envoy/server/admin.h"
+#include "envoy/stats/stats_macros.h"
+#include "envoy/thread_local/thread_local.h"
+
+#include "absl/container/flat_hash_map.h"
+
+#include "vcl/vcl_socket_interface.pb.h"
 
 #include "source/common/network/socket_interface.h"
 
+#include "vcl/vcl_segments.h"
+#include "vcl/vcl_vpp_stats.h"
+#include "vcl/vcl_worker_placement.h"
 #include "vpp/include/vcl/vppcom.h"
 
 namespace Envoy {
@@ -11,25 +25,87 @@ namespace Extensions {
 namespace Network {
 namespace Vcl {
 
-#define VCL_DEBUG (0)
-#define VCL_RX_ZC (0)
-
-#if VCL_DEBUG > 0
-#define VCL_LOG(fmt, _args...) fprintf(stderr, "[%d] " fmt "\n", vppcom_worker_index(), ##_args)
-#else
-#define VCL_LOG(fmt, _args...)
-#endif
+class VclReadyList;
 
 void vcl_interface_worker_register();
 uint32_t& vcl_epoll_handle(uint32_t wrk_index);
+VclReadyList& vcl_ready_list(uint32_t wrk_index);
+
+class VclIoHandle;
+
+// Sessions with file events initialized on the worker. Only accessed by the worker.
+std::vector<VclIoHandle*>& vcl_worker_sessions(uint32_t wrk_index);
 void vcl_interface_register_epoll_event(Envoy::Event::Dispatcher& dispatcher);
+// Runs cb on the event loop of vcl worker wrk_index, e.g., to close a session the worker owns
+// from another thread. Dropped if the worker has no event loop or its thread is shutting down.
+void vclWorkerPost(uint32_t wrk_index, Event::PostCb cb);
+// Listeners whose TLS or QUIC vpp terminates: session protocol and index of the cert/key pair
+// registered with vpp.
+struct VclTlsListener {
+  uint8_t proto;
+  uint32_t ckpair;
+};
+// TLS listener config for port, or nullptr if vpp doesn't terminate TLS on it.
+const VclTlsListener* vcl_tls_listener(uint16_t port);
+// Whether sessions accepted on or connected to port read with zero copy.
+bool vcl_zero_copy_port(uint16_t port);
+
+/**
+ * All vcl bootstrap stats. @see stats_macros.h
+ */
+#define ALL_VCL_BOOTSTRAP_STATS(COUNTER, GAUGE, HISTOGRAM)                                         \
+  GAUGE(workers_registered, NeverImport)                                                           \
+  GAUGE(workers_register_time_ms, NeverImport)                                                     \
+  HISTOGRAM(worker_register_time_us, Microseconds)
+
+struct VclBootstrapStats {
+  ALL_VCL_BOOTSTRAP_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT,
+                          GENERATE_HISTOGRAM_STRUCT)
+};
+
+// Marks threads registered with vcl at bootstrap. Destroyed on the thread when it shuts down.
+struct VclWorkerRegistration : public ThreadLocal::ThreadLocalObject {
+  ~VclWorkerRegistration() override;
+};
 
 class VclSocketInterfaceExtension : public Envoy::Network::SocketInterfaceExtension {
 public:
-  VclSocketInterfaceExtension(Envoy::Network::SocketInterface& sock_interface);
+  VclSocketInterfaceExtension(
+      Envoy::Network::SocketInterface& sock_interface,
+      Server::Configuration::ServerFactoryContext& ctx,
+      const envoy::extensions::network::socket_interface::v3::VclSocketInterface& config);
+  ~VclSocketInterfaceExtension() override;
+
+  // Server::BootstrapExtension
+  void onServerInitialized() override;
 
 private:
+  void registerWorker(Envoy::Event::Dispatcher& dispatcher);
+  void registerAdminHandlers(Server::Admin& admin);
+  // Has every worker dump its sessions between two event loop iterations and keeps the result once
+  // all have. Nothing waits for the workers.
+  void refreshSessionsDump();
+  void publishIoErrors();
+
   std::unique_ptr<Envoy::Network::SocketInterface> socket_interface_;
+  TimeSource& time_source_;
+  VclBootstrapStats stats_;
+  ThreadLocal::SlotPtr slot_;
+  VclWorkerPlacementPtr placement_;
+  VclVppStatsPtr vpp_stats_;
+  Event::Dispatcher& main_dispatcher_;
+  Stats::Scope& scope_;
+  const std::chrono::milliseconds segment_stats_interval_;
+  // Last complete session dump, when it was started, and whether a refresh is in flight
+  std::string sessions_dump_;
+  MonotonicTime sessions_dump_time_;
+  bool sessions_dump_pending_{false};
+  // Refreshed through slot_, so created once workers are registered
+  VclSegmentStatsPtr segment_stats_;
+  // Io error counters under vcl.io_errors., by errno, each with the count last published to it.
+  // Refreshed every second.
+  Event::TimerPtr io_errors_timer_;
+  absl::flat_hash_map<uint32_t, std::pair<Stats::Counter*, uint64_t>> io_errors_;
 };
 
 class VclSocketInterface : public Envoy::Network::SocketInterfaceBase {
@@ -2,18 +2,23 @@
 
 #include <string.h>
 
+#include <algorithm>
+#include <atomic>
+
 #include "source/common/buffer/buffer_impl.h"
 #include "source/common/network/address_impl.h"
 
 #include "vcl/vcl_event.h"
 #include "vcl/vcl_interface.h"
+#include "vcl/vcl_listener_io_handle.h"
+#include "vcl/vcl_trace.h"
 
 namespace Envoy {
 namespace Extensions {
 namespace Network {
 namespace Vcl {
 
-static inline int vcl_wrk_index_or_register() {
+int vcl_wrk_index_or_register() {
   int wrk_index;
 
   if ((wrk_index = vppcom_worker_index()) == -1) {
@@ -23,29 +28,120 @@ static inline int vcl_wrk_index_or_register() {
   return wrk_index;
 }
 
-int peekVclSession(vcl_session_handle_t sh, vppcom_endpt_t* ep, uint32_t* proto) {
-  auto current_wrk = vppcom_worker_index();
-  auto sh_wrk = vppcom_session_worker(sh);
-  uint32_t eplen = sizeof(*ep);
+// Io errors by errno, built once and shared by all workers. Never freed.
+static void keepIoError(Api::IoError*) {}
+
+static Envoy::Network::IoSocketError* const* ioErrors() {
+  static Envoy::Network::IoSocketError* const* errors = []() {
+    auto* errors = new Envoy::Network::IoSocketError*[VclMaxIoErrno];
+    for (uint32_t err = 0; err < VclMaxIoErrno; err++) {
+      errors[err] = err == EAGAIN ? Envoy::Network::IoSocketError::getIoSocketEagainInstance()
+                                  : new Envoy::Network::IoSocketError(err);
+    }
+    return errors;
+  }();
+  return errors;
+}
+
+// Indexed by vcl worker index and errno. Each worker only increments its own row.
+static std::atomic<uint64_t> io_errors[128][VclMaxIoErrno];
+
+Api::IoErrorPtr vclIoError(int32_t result) {
+  const uint32_t err = -result;
+  if (err >= VclMaxIoErrno) {
+    return Api::IoErrorPtr(new Envoy::Network::IoSocketError(err),
+                           Envoy::Network::IoSocketError::deleteIoError);
+  }
+  // EAGAIN is part of normal operation and not counted
+  const int wrk_index = vppcom_worker_index();
+  if (wrk_index >= 0 && result != VPPCOM_EAGAIN) {
+    io_errors[wrk_index][err].fetch_add(1, std::memory_order_relaxed);
+  }
+  // Handed to the caller like any other error, which closes the connection, instead of aborting
+  if (result == VPPCOM_EINVAL) {
+    ENVOY_LOG_MISC(debug, "vcl worker {}: call failed with invalid argument", wrk_index);
+  }
+  return Api::IoErrorPtr(ioErrors()[err], keepIoError);
+}
 
-  // should NOT be used while system is loaded
-  vppcom_worker_index_set(sh_wrk);
+uint64_t vcl_io_errors(uint32_t err) {
+  uint64_t total = 0;
+  for (uint32_t wrk_index = 0; wrk_index < 128; wrk_index++) {
+    total += io_errors[wrk_index][err].load(std::memory_order_relaxed);
+  }
+  return total;
+}
 
-  if (vppcom_session_attr(sh, VPPCOM_ATTR_GET_LCL_ADDR, ep, &eplen)) {
-    return -1;
+std::string vclIoErrorName(uint32_t err) {
+  switch (-static_cast<int32_t>(err)) {
+  case VPPCOM_EAGAIN:
+    return "eagain";
+  case VPPCOM_EFAULT:
+    return "efault";
+  case VPPCOM_ENOMEM:
+    return "enomem";
+  case VPPCOM_EINVAL:
+    return "einval";
+  case VPPCOM_EBADFD:
+    return "ebadfd";
+  case VPPCOM_EAFNOSUPPORT:
+    return "eafnosupport";
+  case VPPCOM_ECONNABORTED:
+    return "econnaborted";
+  case VPPCOM_ECONNRESET:
+    return "econnreset";
+  case VPPCOM_ENOTCONN:
+    return "enotconn";
+  case VPPCOM_ECONNREFUSED:
+    return "econnrefused";
+  case VPPCOM_ETIMEDOUT:
+    return "etimedout";
+  case VPPCOM_EEXIST:
+    return "eexist";
+  case VPPCOM_ENOPROTOOPT:
+    return "enoprotoopt";
+  case VPPCOM_EPIPE:
+    return "epipe";
+  case VPPCOM_ENOENT:
+    return "enoent";
+  case VPPCOM_EADDRINUSE:
+    return "eaddrinuse";
+  case VPPCOM_ENOTSUP:
+    return "enotsup";
+  default:
+    return fmt::format("errno_{}", err);
   }
+}
 
-  uint32_t buflen = sizeof(uint32_t);
-  if (vppcom_session_attr(sh, VPPCOM_ATTR_GET_PROTOCOL, proto, &buflen)) {
-    return -1;
+void closeVclSession(vcl_session_handle_t sh) {
+  const int sh_wrk = vppcom_session_worker(sh);
+  if (sh_wrk == vppcom_worker_index()) {
+    vppcom_session_close(sh);
+    return;
   }
+  // Vcl sessions are only touched by their worker
+  vclWorkerPost(sh_wrk, [sh]() {
+    VCL_TRACE(Close, sh, 0, 0);
+    vppcom_session_close(sh);
+  });
+}
 
-  vppcom_worker_index_set(current_wrk);
+uint32_t vclEpollEvents(uint32_t events) {
+  uint32_t epoll_events = EPOLLET;
 
-  return 0;
+  if (events & Event::FileReadyType::Read) {
+    epoll_events |= EPOLLIN;
+  }
+  if (events & Event::FileReadyType::Write) {
+    epoll_events |= EPOLLOUT;
+  }
+  if (events & Event::FileReadyType::Closed) {
+    epoll_events |= EPOLLERR | EPOLLHUP;
+  }
+  return epoll_events;
 }
 
-static void vclEndptCopy(sockaddr* addr, socklen_t* addrlen, const vppcom_endpt_t& ep) {
+void vclEndptCopy(sockaddr* addr, socklen_t* addrlen, const vppcom_endpt_t& ep) {
   if (ep.is_ip4) {
     sockaddr_in* addr4 = reinterpret_cast<sockaddr_in*>(addr);
     addr4->sin_family = AF_INET;
@@ -96,49 +192,151 @@ Envoy::Network::Address::InstanceConstSharedPtr vclEndptToAddress(const vppcom_e
 }
 
 static void vclEndptFromAddress(vppcom_endpt_t& endpt,
-                                Envoy::Network::Address::InstanceConstSharedPtr address) {
+                                const Envoy::Network::Address::Instance& address) {
   endpt.is_cut_thru = 0;
-  if (address->ip()->version() == Envoy::Network::Address::IpVersion::v4) {
-    const sockaddr_in* in = reinterpret_cast<const sockaddr_in*>(address->sockAddr());
+  if (address.ip()->version() == Envoy::Network::Address::IpVersion::v4) {
+    const sockaddr_in* in = reinterpret_cast<const sockaddr_in*>(address.sockAddr());
     endpt.is_ip4 = 1;
     endpt.ip = const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(&in->sin_addr));
     endpt.port = static_cast<uint16_t>(in->sin_port);
   } else {
-    const sockaddr_in6* in6 = reinterpret_cast<const sockaddr_in6*>(address->sockAddr());
+    const sockaddr_in6* in6 = reinterpret_cast<const sockaddr_in6*>(address.sockAddr());
     endpt.is_ip4 = 0;
     endpt.ip = const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(&in6->sin6_addr));
     endpt.port = static_cast<uint16_t>(in6->sin6_port);
   }
 }
 
+int vclTlsSessionCreate(uint16_t port) {
+  const VclTlsListener* tls_listener = vcl_tls_listener(port);
+  if (tls_listener == nullptr) {
+    return VPPCOM_EINVAL;
+  }
+  int sh = vppcom_session_create(tls_listener->proto, 1);
+  if (sh < 0) {
+    return sh;
+  }
+  uint32_t ckpair_index = tls_listener->ckpair, len = sizeof(ckpair_index);
+  int rv = vppcom_session_attr(sh, VPPCOM_ATTR_SET_CKPAIR, &ckpair_index, &len);
+  if (rv < 0) {
+    vppcom_session_close(sh);
+    return rv;
+  }
+  return sh;
+}
+
+VclListenSessions::VclListenSessions(uint32_t sh) : sh_(sh) {
+  endpoint_.ip = endpoint_ip_;
+  uint32_t len = sizeof(endpoint_);
+  vppcom_session_attr(sh, VPPCOM_ATTR_GET_LCL_ADDR, &endpoint_, &len);
+  len = sizeof(proto_);
+  vppcom_session_attr(sh, VPPCOM_ATTR_GET_PROTOCOL, &proto_, &len);
+}
+
+void VclListenSessions::endpoint(vppcom_endpt_t& ep, uint8_t* ip) const {
+  ep = endpoint_;
+  memcpy(ip, endpoint_ip_, sizeof(endpoint_ip_));
+  ep.ip = ip;
+}
+
+VclListenSessions::~VclListenSessions() {
+  // Worker listen sessions are normally closed by their workers when file events are reset. The
+  // last duplicate may go away on any thread, so what's left is closed by the owning workers.
+  for (auto& wrk_listener : wrk_listeners_) {
+    for (uint32_t sh : wrk_listener.quic_connections) {
+      closeVclSession(sh);
+    }
+    if (VCL_SH_VALID(wrk_listener.sh)) {
+      closeVclSession(wrk_listener.sh);
+    }
+  }
+  closeVclSession(sh_);
+}
+
 VclIoHandle::~VclIoHandle() {
+  if (ready_index_ >= 0) {
+    vcl_ready_list(vppcom_worker_index()).remove(*this);
+  }
   if (VCL_SH_VALID(sh_)) {
     VclIoHandle::close();
   }
+  unregisterSession();
+}
+
+void VclIoHandle::registerSession(uint32_t wrk_index) {
+  if (registered_wrk_index_ >= 0) {
+    return;
+  }
+  registered_wrk_index_ = wrk_index;
+  auto& sessions = vcl_worker_sessions(wrk_index);
+  session_index_ = sessions.size();
+  sessions.push_back(this);
+}
+
+void VclIoHandle::unregisterSession() {
+  if (registered_wrk_index_ < 0) {
+    return;
+  }
+  // Handles are only unregistered by the worker that owns them, e.g., listeners reset their events
+  // on their worker before the main thread closes them.
+  ASSERT(registered_wrk_index_ == vppcom_worker_index());
+  // Swapped with the last session, so removal is constant time
+  auto& sessions = vcl_worker_sessions(registered_wrk_index_);
+  sessions[session_index_] = sessions.back();
+  sessions[session_index_]->session_index_ = session_index_;
+  sessions.pop_back();
+  session_index_ = -1;
+  registered_wrk_index_ = -1;
+}
+
+void VclIoHandle::dumpState(std::ostream& os, MonotonicTime now) { dumpSession(os, now, sh_); }
+
+void VclIoHandle::dumpSession(std::ostream& os, MonotonicTime now, uint32_t sh) {
+  os << fmt::format("  session sh 0x{:x}", sh_);
+  if (!isOpen() || !VCL_SH_VALID(sh)) {
+    os << " closed\n";
+    return;
+  }
+  if (sh != sh_) {
+    os << fmt::format(" wrk sh 0x{:x}", sh);
+  }
+
+  os << fmt::format(" vpp session {} interest 0x{:x} pending 0x{:x}", vppcom_session_index(sh),
+                    events_, ready_events_);
+  if (last_event_ != MonotonicTime()) {
+    os << fmt::format(" last event {}ms ago",
+                      std::chrono::duration_cast<std::chrono::milliseconds>(now - last_event_)
+                          .count());
+  }
+  uint32_t rx_fifo_len = 0, tx_fifo_len = 0, len = sizeof(uint32_t);
+  vppcom_session_attr(sh, VPPCOM_ATTR_GET_RX_FIFO_LEN, &rx_fifo_len, &len);
+  len = sizeof(uint32_t);
+  vppcom_session_attr(sh, VPPCOM_ATTR_GET_TX_FIFO_LEN, &tx_fifo_len, &len);
+  int32_t rx_bytes = vppcom_session_attr(sh, VPPCOM_ATTR_GET_NREAD, nullptr, nullptr);
+  int32_t tx_free = vppcom_session_attr(sh, VPPCOM_ATTR_GET_NWRITE, nullptr, nullptr);
+  os << fmt::format(" rx fifo {}/{} tx fifo {}/{}\n", std::max(rx_bytes, 0), rx_fifo_len,
+                    tx_fifo_len - std::min<uint32_t>(std::max(tx_free, 0), tx_fifo_len),
+                    tx_fifo_len);
+}
+
+void vclDumpWorkerSessions(uint32_t wrk_index, MonotonicTime now, std::ostream& os) {
+  auto& sessions = vcl_worker_sessions(wrk_index);
+  os << fmt::format("worker {} epoll handle {} sessions {}\n", wrk_index,
+                    vcl_epoll_handle(wrk_index), sessions.size());
+  for (VclIoHandle* vcl_handle : sessions) {
+    vcl_handle->dumpState(os, now);
+  }
 }
 
 Api::IoCallUint64Result VclIoHandle::close() {
-  VCL_LOG("closing sh %x", sh_);
+  VCL_TRACE(Close, sh_, 0, 0);
   RELEASE_ASSERT(VCL_SH_VALID(sh_), "sh must be valid");
-  int rc = 0, wrk_index;
-
-  wrk_index = vcl_wrk_index_or_register();
-
-  if (is_listener_) {
-    if (wrk_index) {
-      auto sh = wrk_listener_->sh();
-      RELEASE_ASSERT(wrk_index == vppcom_session_worker(sh), "listener close on wrong thread");
-      clearChildWrkListener();
-      rc = vppcom_session_close(sh);
-    } else {
-      clearChildWrkListener();
-      rc = vppcom_session_close(sh_);
-      VCL_SET_SH_INVALID(sh_);
-    }
-  } else {
-    rc = vppcom_session_close(sh_);
-    VCL_SET_SH_INVALID(sh_);
+
+  if (registered_wrk_index_ == vcl_wrk_index_or_register()) {
+    unregisterSession();
   }
+  int rc = vppcom_session_close(sh_);
+  VCL_SET_SH_INVALID(sh_);
 
   return Api::IoCallUint64Result(
       rc, Api::IoErrorPtr(nullptr, Envoy::Network::IoSocketError::deleteIoError));
@@ -152,8 +350,6 @@ Api::IoCallUint64Result VclIoHandle::readv(uint64_t max_length, Buffer::RawSlice
     return vclCallResultToIoCallResult(VPPCOM_EBADFD);
   }
 
-  VCL_LOG("reading on sh %x", sh_);
-
   int32_t result = 0, rv = 0, num_bytes_read = 0;
   size_t slice_length;
 
@@ -169,40 +365,10 @@ Api::IoCallUint64Result VclIoHandle::readv(uint64_t max_length, Buffer::RawSlice
     }
   }
   result = (num_bytes_read == 0) ? rv : num_bytes_read;
-  VCL_LOG("done reading on sh %x bytes %d result %d", sh_, num_bytes_read, result);
+  VCL_TRACE(Read, sh_, 0, result);
   return vclCallResultToIoCallResult(result);
 }
 
-#if VCL_RX_ZC
-Api::IoCallUint64Result VclIoHandle::read(Buffer::Instance& buffer, absl::optional<uint64_t>) {
-  vppcom_data_segment_t ds[16];
-  int32_t rv;
-
-  rv = vppcom_session_read_segments(sh_, ds, 16, ~0);
-  if (rv < 0) {
-    return vclCallResultToIoCallResult(rv);
-  }
-
-  uint32_t ds_index = 0, sh = sh_, len;
-  int32_t n_bytes = 0;
-  while (n_bytes < rv) {
-    len = ds[ds_index].len;
-    auto fragment = new Envoy::Buffer::BufferFragmentImpl(
-        ds[ds_index].data, len,
-        [&, sh](const void*, size_t data_len,
-                const Envoy::Buffer::BufferFragmentImpl* this_fragment) {
-          vppcom_session_free_segments(sh, data_len);
-          delete this_fragment;
-        });
-
-    buffer.addBufferFragment(*fragment);
-    n_bytes += len;
-    ds_index += 1;
-  }
-
-  return vclCallResultToIoCallResult(rv);
-}
-#else
 Api::IoCallUint64Result VclIoHandle::read(Buffer::Instance& buffer,
                                           absl::optional<uint64_t> max_length_opt) {
   uint64_t max_length = max_length_opt.value_or(UINT64_MAX);
@@ -218,15 +384,12 @@ Api::IoCallUint64Result VclIoHandle::read(Buffer::Instance& buffer,
   reservation.commit(bytes_to_commit);
   return result;
 }
-#endif
 
 Api::IoCallUint64Result VclIoHandle::writev(const Buffer::RawSlice* slices, uint64_t num_slice) {
   if (!VCL_SH_VALID(sh_)) {
     return vclCallResultToIoCallResult(VPPCOM_EBADFD);
   }
 
-  VCL_LOG("writing on sh %x", sh_);
-
   uint64_t num_bytes_written = 0;
   int32_t result = 0, rv = 0;
 
@@ -238,6 +401,7 @@ Api::IoCallUint64Result VclIoHandle::writev(const Buffer::RawSlice* slices, uint
     num_bytes_written += rv;
   }
   result = (num_bytes_written == 0) ? rv : num_bytes_written;
+  VCL_TRACE(Write, sh_, 0, result);
 
   return vclCallResultToIoCallResult(result);
 }
@@ -253,103 +417,20 @@ Api::IoCallUint64Result VclIoHandle::write(Buffer::Instance& buffer) {
 }
 
 Api::IoCallUint64Result VclIoHandle::recv(void* buffer, size_t length, int flags) {
-  VCL_LOG("recv on sh %x", sh_);
   auto rv = vppcom_session_recvfrom(sh_, buffer, length, flags, 0);
+  VCL_TRACE(Recv, sh_, flags, rv);
   return vclCallResultToIoCallResult(rv);
 }
 
-Api::IoCallUint64Result VclIoHandle::sendmsg(const Buffer::RawSlice* slices, uint64_t num_slice,
-                                             int, const Envoy::Network::Address::Ip*,
+Api::IoCallUint64Result VclIoHandle::sendmsg(const Buffer::RawSlice*, uint64_t, int,
+                                             const Envoy::Network::Address::Ip*,
                                              const Envoy::Network::Address::Instance&) {
-  if (!VCL_SH_VALID(sh_)) {
-    return vclCallResultToIoCallResult(VPPCOM_EBADFD);
-  }
-
-  absl::FixedArray<iovec> iov(num_slice);
-  uint64_t num_slices_to_write = 0;
-  uint64_t num_bytes_written = 0;
-
-  for (uint64_t i = 0; i < num_slice; i++) {
-    if (slices[i].mem_ != nullptr && slices[i].len_ != 0) {
-      iov[num_slices_to_write].iov_base = slices[i].mem_;
-      iov[num_slices_to_write].iov_len = slices[i].len_;
-      num_slices_to_write++;
-    }
-  }
-  if (num_slices_to_write == 0) {
-    return Api::ioCallUint64ResultNoError();
-  }
-
-  // VCL has no sendmsg semantics- Treat as a session write followed by a flush
-  auto result = 0;
-  for (uint64_t i = 0; i < num_slices_to_write; i++) {
-    int n;
-    if (i < (num_slices_to_write - 1)) {
-      n = vppcom_session_write(sh_, iov[i].iov_base, iov[i].iov_len);
-      if (n < 0) {
-        result = (num_bytes_written == 0) ? n : num_bytes_written;
-        break;
-      }
-    } else {
-      // Flush after the last segment is written
-      n = vppcom_session_write_msg(sh_, iov[i].iov_base, iov[i].iov_len);
-      if (n < 0) {
-        result = (num_bytes_written == 0) ? n : num_bytes_written;
-        break;
-      }
-    }
-    num_bytes_written += n;
-  }
-
-  return vclCallResultToIoCallResult(result);
+  return vclCallResultToIoCallResult(-EOPNOTSUPP);
 }
 
-Api::IoCallUint64Result VclIoHandle::recvmsg(Buffer::RawSlice* slices, const uint64_t num_slice,
-                                             uint32_t self_port, RecvMsgOutput& output) {
-  if (!VCL_SH_VALID(sh_)) {
-    return vclCallResultToIoCallResult(VPPCOM_EBADFD);
-  }
-
-  absl::FixedArray<iovec> iov(num_slice);
-  uint64_t num_slices_for_read = 0;
-  uint64_t num_bytes_recvd = 0;
-  for (uint64_t i = 0; i < num_slice; i++) {
-    if (slices[i].mem_ != nullptr && slices[i].len_ != 0) {
-      iov[num_slices_for_read].iov_base = slices[i].mem_;
-      iov[num_slices_for_read].iov_len = slices[i].len_;
-      ++num_slices_for_read;
-    }
-  }
-
-  // VCL has no recvmsg semantics- treat as a read into each slice, which is not
-  // as cumbersome as it sounds, since VCL will simply copy from shared mem buffers
-  // if the data is available.
-  uint8_t ipaddr[sizeof(absl::uint128)];
-  vppcom_endpt_t endpt;
-  endpt.ip = ipaddr;
-  endpt.port = static_cast<uint16_t>(self_port);
-  uint32_t result = 0;
-
-  for (uint64_t i = 0; i < num_slices_for_read; i++) {
-    int n;
-    n = vppcom_session_recvfrom(sh_, iov[i].iov_base, iov[i].iov_len, 0, &endpt);
-    if (n < 0) {
-      result = (num_bytes_recvd == 0) ? n : num_bytes_recvd;
-      break;
-    }
-    if (i == 0) {
-      output.msg_[0].peer_address_ = vclEndptToAddress(endpt, sh_);
-    }
-    num_bytes_recvd += n;
-  }
-
-  if (result < 0) {
-    return vclCallResultToIoCallResult(result);
-  }
-
-  output.dropped_packets_ = nullptr;
-
-  return vclCallResultToIoCallResult(result);
+Api::IoCallUint64Result VclIoHandle::recvmsg(Buffer::RawSlice*, const uint64_t, uint32_t,
+                                             RecvMsgOutput&) {
+  return vclCallResultToIoCallResult(-EOPNOTSUPP);
 }
 
 Api::IoCallUint64Result VclIoHandle::recvmmsg(RawSliceArrays&, uint32_t, RecvMsgOutput&) {
@@ -367,47 +448,14 @@ Api::SysCallIntResult VclIoHandle::bind(Envoy::Network::Address::InstanceConstSh
   RELEASE_ASSERT(wrk_index != -1, "should be initialized");
 
   vppcom_endpt_t endpt;
-  vclEndptFromAddress(endpt, address);
+  vclEndptFromAddress(endpt, *address);
   int32_t rv = vppcom_session_bind(sh_, &endpt);
   return {rv < 0 ? -1 : 0, -rv};
 }
 
-Api::SysCallIntResult VclIoHandle::listen(int) {
-  auto wrk_index = vcl_wrk_index_or_register();
-  RELEASE_ASSERT(wrk_index != -1, "should be initialized");
-
-  VCL_LOG("trying to listen sh %u", sh_);
-  RELEASE_ASSERT(is_listener_ == false, "");
-  RELEASE_ASSERT(vppcom_session_worker(sh_) == wrk_index, "");
-
-  is_listener_ = true;
-
-  if (!wrk_index)
-    not_listened_ = true;
-
-  return {0, 0};
-}
-
-Envoy::Network::IoHandlePtr VclIoHandle::accept(sockaddr* addr, socklen_t* addrlen) {
-  auto wrk_index = vcl_wrk_index_or_register();
-  RELEASE_ASSERT(wrk_index != -1 && isListener(), "must have worker and must be listener");
+Api::SysCallIntResult VclIoHandle::listen(int) { return {-1, EOPNOTSUPP}; }
 
-  auto sh = sh_;
-  if (wrk_index) {
-    sh = wrk_listener_->sh();
-    VCL_LOG("trying to accept fd %d sh %x", fd_, sh);
-  }
-
-  vppcom_endpt_t endpt;
-  sockaddr_storage ss;
-  endpt.ip = reinterpret_cast<uint8_t*>(&ss);
-  auto new_sh = vppcom_session_accept(sh, &endpt, O_NONBLOCK);
-  if (new_sh >= 0) {
-    vclEndptCopy(addr, addrlen, endpt);
-    return std::make_unique<VclIoHandle>(new_sh, 1 << 23);
-  }
-  return nullptr;
-}
+Envoy::Network::IoHandlePtr VclIoHandle::accept(sockaddr*, socklen_t*) { return nullptr; }
 
 Api::SysCallIntResult
 VclIoHandle::connect(Envoy::Network::Address::InstanceConstSharedPtr address) {
@@ -417,14 +465,25 @@ VclIoHandle::connect(Envoy::Network::Address::InstanceConstSharedPtr address) {
   vppcom_endpt_t endpt;
   uint8_t ipaddr[sizeof(absl::uint128)];
   endpt.ip = ipaddr;
-  vclEndptFromAddress(endpt, address);
+  vclEndptFromAddress(endpt, *address);
   int32_t rv = vppcom_session_connect(sh_, &endpt);
+  VCL_TRACE(Connect, sh_, 0, rv);
+  return {rv < 0 ? -1 : 0, -rv};
+}
+
+Api::SysCallIntResult VclIoHandle::shutdown(int how) {
+  if (!VCL_SH_VALID(sh_)) {
+    return {-1, VPPCOM_EBADFD};
+  }
+  // Shutting down writes sends a fin once the tx fifo drains, shutting down reads has vcl report
+  // eof. Fifos and the vpp session are released once both sides closed.
+  int32_t rv = vppcom_session_shutdown(sh_, how);
+  VCL_TRACE(Shutdown, sh_, how, rv);
   return {rv < 0 ? -1 : 0, -rv};
 }
 
 Api::SysCallIntResult VclIoHandle::setOption(int level, int optname, const void* optval,
                                              socklen_t optlen) {
-  VCL_LOG("trying to set option");
   if (!VCL_SH_VALID(sh_)) {
     return {-1, VPPCOM_EBADFD};
   }
@@ -495,7 +554,6 @@ Api::SysCallIntResult VclIoHandle::setOption(int level, int optname, const void*
 
 Api::SysCallIntResult VclIoHandle::getOption(int level, int optname, void* optval,
                                              socklen_t* optlen) {
-  VCL_LOG("trying to get option\n");
   if (!VCL_SH_VALID(sh_)) {
     return {-1, VPPCOM_EBADFD};
   }
@@ -598,7 +656,6 @@ Api::SysCallIntResult VclIoHandle::setBlocking(bool) {
 }
 
 absl::optional<int> VclIoHandle::domain() {
-  VCL_LOG("grabbing domain sh %x", sh_);
   return {AF_INET};
 };
 
@@ -614,7 +671,6 @@ Envoy::Network::Address::InstanceConstSharedPtr VclIoHandle::localAddress() {
 }
 
 Envoy::Network::Address::InstanceConstSharedPtr VclIoHandle::peerAddress() {
-  VCL_LOG("grabbing peer address sh %x", sh_);
   vppcom_endpt_t ep;
   uint32_t eplen = sizeof(ep);
   uint8_t addr_buf[sizeof(struct sockaddr_in6)];
@@ -626,121 +682,474 @@ Envoy::Network::Address::InstanceConstSharedPtr VclIoHandle::peerAddress() {
 }
 
 void VclIoHandle::updateEvents(uint32_t events) {
+  VCL_TRACE(EventsUpdate, sh_, events, 0);
+  events_ = events;
+
+  struct epoll_event ev;
+  ev.events = vclEpollEvents(events);
+  ev.data.u64 = reinterpret_cast<uint64_t>(this);
+  vppcom_epoll_ctl(vcl_epoll_handle(vcl_wrk_index_or_register()), EPOLL_CTL_MOD, sh_, &ev);
+}
+
+void VclIoHandle::initializeFileEvent(Event::Dispatcher& dispatcher, Event::FileReadyCb cb,
+                                      Event::FileTriggerType, uint32_t events) {
+  VCL_TRACE(EventsInit, sh_, events, 0);
+
   auto wrk_index = vcl_wrk_index_or_register();
-  VclIoHandle* vcl_handle = this;
+  vcl_interface_register_epoll_event(dispatcher);
+
+  struct epoll_event ev;
+  ev.events = vclEpollEvents(events);
+  ev.data.u64 = reinterpret_cast<uint64_t>(this);
+
+  cb_ = cb;
+  events_ = events;
+  vppcom_epoll_ctl(vcl_epoll_handle(wrk_index), EPOLL_CTL_ADD, sh_, &ev);
+  registerSession(wrk_index);
 
-  if (wrk_index && is_listener_) {
-    vcl_handle = wrk_listener_.get();
+  file_event_ = Event::FileEventPtr{new VclEvent(*this)};
+}
+
+void VclIoHandle::resetFileEvents() { file_event_.reset(); }
+
+absl::optional<std::chrono::milliseconds> VclIoHandle::lastRoundTripTime() { return {}; }
+
+VclStreamIoHandle::RxLease::~RxLease() {
+  if (closed) {
+    vppcom_session_close(sh);
   }
+}
 
-  struct epoll_event ev;
-  ev.events = EPOLLET;
+VclStreamIoHandle::~VclStreamIoHandle() {
+  // Drop the event before the listener it may refer to
+  if (isOpen()) {
+    VclStreamIoHandle::close();
+  }
+  file_event_.reset();
+}
 
-  if (events & Event::FileReadyType::Read) {
-    ev.events |= EPOLLIN;
+Api::IoCallUint64Result VclStreamIoHandle::close() {
+  if (listener_) {
+    auto result = listener_->close();
+    VCL_SET_SH_INVALID(sh_);
+    return result;
   }
-  if (events & Event::FileReadyType::Write) {
-    ev.events |= EPOLLOUT;
+
+  Api::IoCallUint64Result result = Api::ioCallUint64ResultNoError();
+  if (rx_lease_ && rx_lease_.use_count() > 1) {
+    // Buffers still hold rx segments. Stop events and send a fin now, the session is closed once
+    // the last segment is returned.
+    VCL_TRACE(Close, sh_, 0, 0);
+    if (registered_wrk_index_ >= 0) {
+      vppcom_epoll_ctl(vcl_epoll_handle(registered_wrk_index_), EPOLL_CTL_DEL, sh_, nullptr);
+      unregisterSession();
+    }
+    vppcom_session_shutdown(sh_, SHUT_RDWR);
+    rx_lease_->closed = true;
+    VCL_SET_SH_INVALID(sh_);
+  } else {
+    result = VclIoHandle::close();
   }
-  if (events & Event::FileReadyType::Closed) {
-    ev.events |= EPOLLERR | EPOLLHUP;
+  rx_lease_.reset();
+  return result;
+}
+
+Api::IoCallUint64Result VclStreamIoHandle::read(Buffer::Instance& buffer,
+                                                absl::optional<uint64_t> max_length) {
+  if (!zero_copy_rx_ || !VCL_SH_VALID(sh_)) {
+    return VclIoHandle::read(buffer, max_length);
+  }
+
+  vppcom_data_segment_t ds[16];
+  const uint32_t max_bytes = std::min<uint64_t>(max_length.value_or(UINT32_MAX), UINT32_MAX);
+  int32_t rv = vppcom_session_read_segments(sh_, ds, 16, max_bytes);
+  VCL_TRACE(Read, sh_, 0, rv);
+  if (rv <= 0) {
+    return vclCallResultToIoCallResult(rv);
   }
 
-  ev.data.u64 = reinterpret_cast<uint64_t>(vcl_handle);
+  if (!rx_lease_) {
+    rx_lease_ = std::make_shared<RxLease>(sh_);
+  }
+  int32_t n_bytes = 0;
+  for (uint32_t i = 0; n_bytes < rv; i++) {
+    // Buffers drain in order, so segments are returned in the order they were read
+    auto fragment = new Envoy::Buffer::BufferFragmentImpl(
+        ds[i].data, ds[i].len,
+        [lease = rx_lease_](const void*, size_t data_len,
+                            const Envoy::Buffer::BufferFragmentImpl* this_fragment) {
+          vppcom_session_free_segments(lease->sh, data_len);
+          delete this_fragment;
+        });
+    buffer.addBufferFragment(*fragment);
+    n_bytes += ds[i].len;
+  }
+  return vclCallResultToIoCallResult(rv);
+}
 
-  vppcom_epoll_ctl(vcl_epoll_handle(wrk_index), EPOLL_CTL_MOD, vcl_handle->sh(), &ev);
+Api::SysCallIntResult VclStreamIoHandle::listen(int backlog) {
+  if (!listener_) {
+    listener_ = std::make_unique<VclListenerIoHandle>(sh_, nullptr);
+  }
+  return listener_->listen(backlog);
 }
 
-void VclIoHandle::initializeFileEvent(Event::Dispatcher& dispatcher, Event::FileReadyCb cb,
-                                      Event::FileTriggerType, uint32_t events) {
-  VCL_LOG("adding events for sh %x fd %u isListener %u", sh_, fd_, isListener());
+Envoy::Network::IoHandlePtr VclStreamIoHandle::accept(sockaddr* addr, socklen_t* addrlen) {
+  RELEASE_ASSERT(listener_ != nullptr, "must be listener");
+  return listener_->accept(addr, addrlen);
+}
 
-  auto wrk_index = vcl_wrk_index_or_register();
-  vcl_interface_register_epoll_event(dispatcher);
+Api::SysCallIntResult
+VclStreamIoHandle::connect(Envoy::Network::Address::InstanceConstSharedPtr address) {
+  if (address->ip() && vcl_zero_copy_port(address->ip()->port())) {
+    zero_copy_rx_ = true;
+  }
+  return VclIoHandle::connect(address);
+}
 
-  VclIoHandle* vcl_handle = this;
-
-  if (is_listener_) {
-    // If this is not the main worker, make sure a worker listener exists
-    if (wrk_index) {
-      if (!wrk_listener_) {
-        vppcom_endpt_t ep;
-        uint8_t addr_buf[sizeof(struct sockaddr_in6)];
-        ep.ip = addr_buf;
-        uint32_t proto;
-
-        if (peekVclSession(sh_, &ep, &proto)) {
-          RELEASE_ASSERT(0, "");
-        }
-
-        auto address = vclEndptToAddress(ep, -1);
-        auto sh = vppcom_session_create(proto, 1);
-        wrk_listener_ = std::make_unique<VclIoHandle>(static_cast<uint32_t>(sh), 1 << 23);
-        wrk_listener_->bind(address);
-        uint32_t rv = vppcom_session_listen(sh, 5);
-        if (rv) {
-          VCL_LOG ("listen failed sh %x", sh);
-          return;
-        }
-        wrk_listener_->setChildWrkListener(this);
-      }
-      vcl_handle = wrk_listener_.get();
-    // On main worker, no need to create worker listeners
-    } else if (not_listened_) {
-      vppcom_session_listen(sh_, 5);
-      not_listened_ = false;
+Api::SysCallIntResult
+VclStreamIoHandle::bind(Envoy::Network::Address::InstanceConstSharedPtr address) {
+  // Listeners on ports whose TLS vpp terminates need a TLS or QUIC session. Vcl binds only record
+  // the endpoint, so the TCP session can still be swapped for one. Options set before bind stay
+  // with the TCP session.
+  if (!listener_ && VCL_SH_VALID(sh_) && address->ip() &&
+      vcl_tls_listener(address->ip()->port()) != nullptr) {
+    int sh = vclTlsSessionCreate(address->ip()->port());
+    if (sh < 0) {
+      return {-1, -sh};
     }
+    ENVOY_LOG(debug, "vcl sh 0x{:x}: tls on port {} terminated by vpp, session 0x{:x}", sh_,
+              address->ip()->port(), sh);
+    vppcom_session_close(sh_);
+    sh_ = sh;
   }
+  return VclIoHandle::bind(address);
+}
 
-  struct epoll_event ev;
-  ev.events = EPOLLET;
+Api::SysCallIntResult VclStreamIoHandle::setOption(int level, int optname, const void* optval,
+                                                   socklen_t optlen) {
+  if (level != SOL_SOCKET || optname != SO_LINGER) {
+    return VclIoHandle::setOption(level, optname, optval, optlen);
+  }
+  if (optlen != sizeof(linger_)) {
+    return {-1, EINVAL};
+  }
+  struct linger linger;
+  memcpy(&linger, optval, sizeof(linger));
+  // Vcl has no app initiated reset, closes are always graceful
+  if (linger.l_onoff && !linger.l_linger) {
+    return {-1, ENOPROTOOPT};
+  }
+  linger_ = linger;
+  return {0, 0};
+}
 
-  if (events & Event::FileReadyType::Read) {
-    ev.events |= EPOLLIN;
+Api::SysCallIntResult VclStreamIoHandle::getOption(int level, int optname, void* optval,
+                                                   socklen_t* optlen) {
+  if (level != SOL_SOCKET || optname != SO_LINGER) {
+    return VclIoHandle::getOption(level, optname, optval, optlen);
   }
-  if (events & Event::FileReadyType::Write) {
-    ev.events |= EPOLLOUT;
+  if (*optlen < sizeof(linger_)) {
+    return {-1, EINVAL};
   }
-  if (events & Event::FileReadyType::Closed) {
-    ev.events |= EPOLLERR | EPOLLHUP;
+  memcpy(optval, &linger_, sizeof(linger_));
+  *optlen = sizeof(linger_);
+  return {0, 0};
+}
+
+void VclStreamIoHandle::initializeFileEvent(Event::Dispatcher& dispatcher, Event::FileReadyCb cb,
+                                            Event::FileTriggerType trigger, uint32_t events) {
+  if (!listener_) {
+    VclIoHandle::initializeFileEvent(dispatcher, cb, trigger, events);
+    return;
   }
+  // Events are delivered to and updated through the listener
+  if (listener_->registerListener(dispatcher, cb, events)) {
+    file_event_ = Event::FileEventPtr{new VclEvent(*listener_)};
+  }
+}
 
-  cb_ = cb;
-  ev.data.u64 = reinterpret_cast<uint64_t>(vcl_handle);
-  vppcom_epoll_ctl(vcl_epoll_handle(wrk_index), EPOLL_CTL_ADD, vcl_handle->sh(), &ev);
+void VclStreamIoHandle::resetFileEvents() {
+  VclIoHandle::resetFileEvents();
+  if (listener_) {
+    listener_->resetFileEvents();
+  }
+}
 
-  file_event_ = Event::FileEventPtr{new VclEvent(dispatcher, *vcl_handle, cb)};
+IoHandlePtr VclStreamIoHandle::duplicate() {
+  // Only listen sockets are duplicated, possibly before they're listened on
+  if (!listener_) {
+    listener_ = std::make_unique<VclListenerIoHandle>(sh_, nullptr);
+  }
+  return listener_->duplicate();
 }
 
-IoHandlePtr VclIoHandle::duplicate() {
-  auto wrk_index = vcl_wrk_index_or_register();
-  VCL_LOG("duplicate called");
-  fprintf(stderr, "duplicate session %u\n", sh_);
+VclDatagramIoHandle::~VclDatagramIoHandle() {
+  if (isOpen()) {
+    VclDatagramIoHandle::close();
+  }
+}
+
+Api::IoCallUint64Result VclDatagramIoHandle::close() {
+  if (!shared_sessions_) {
+    VCL_SET_SH_INVALID(io_sh_);
+    return VclIoHandle::close();
+  }
+  // The vpp session is closed once the last duplicate lets go of it
+  VCL_TRACE(Close, sh_, 0, 0);
+  if (registered_wrk_index_ == vcl_wrk_index_or_register()) {
+    unregisterSession();
+  }
+  releaseWrkSession();
+  shared_sessions_.reset();
+  VCL_SET_SH_INVALID(sh_);
+  return Api::ioCallUint64ResultNoError();
+}
 
+uint32_t VclDatagramIoHandle::ioSession() {
+  if (ABSL_PREDICT_TRUE(VCL_SH_VALID(io_sh_)) || !VCL_SH_VALID(sh_)) {
+    return io_sh_;
+  }
+  return bindWrkSession();
+}
+
+uint32_t VclDatagramIoHandle::bindWrkSession() {
+  auto wrk_index = vcl_wrk_index_or_register();
+  // The worker that owns the duplicated session uses it directly
   if (vppcom_session_worker(sh_) == wrk_index) {
-    return std::unique_ptr<VclIoHandle>(this);
+    io_sh_ = sh_;
+    return io_sh_;
   }
 
-  // Find what must be duplicated. Asssume this is ONLY called for listeners
-  vppcom_endpt_t ep;
-  uint8_t addr_buf[sizeof(struct sockaddr_in6)];
-  ep.ip = addr_buf;
-  uint32_t proto;
+  auto& wrk_session = shared_sessions_->wrkListener(wrk_index);
+  if (!VCL_SH_VALID(wrk_session.sh)) {
+    vppcom_endpt_t ep;
+    uint8_t addr_buf[sizeof(struct sockaddr_in6)];
+    shared_sessions_->endpoint(ep, addr_buf);
+    int sh = vppcom_session_create(VPPCOM_PROTO_UDP, 1);
+    if (sh < 0) {
+      ENVOY_LOG(error, "vcl worker {}: session create failed rv {}", wrk_index, sh);
+      return VCL_INVALID_SH;
+    }
+    // Vcl binds UDP sessions in vpp right away, there's no listen
+    int rv = vppcom_session_bind(sh, &ep);
+    if (rv) {
+      ENVOY_LOG(error, "vcl worker {}: bind failed sh 0x{:x} rv {}", wrk_index, sh, rv);
+      vppcom_session_close(sh);
+      return VCL_INVALID_SH;
+    }
+    wrk_session.sh = sh;
+  }
+  wrk_session.owner = this;
+  io_sh_ = wrk_session.sh;
+  return io_sh_;
+}
+
+void VclDatagramIoHandle::releaseWrkSession() {
+  const uint32_t sh = io_sh_;
+  VCL_SET_SH_INVALID(io_sh_);
+  if (!VCL_SH_VALID(sh) || sh == sh_) {
+    return;
+  }
+  // Sessions left on other workers are closed by them once the last duplicate goes away
+  const int wrk_index = vppcom_session_worker(sh);
+  if (wrk_index != vppcom_worker_index()) {
+    return;
+  }
+  auto& wrk_session = shared_sessions_->wrkListener(wrk_index);
+  if (wrk_session.owner != this) {
+    return;
+  }
+  VCL_TRACE(Close, sh, 0, 0);
+  vppcom_session_close(sh);
+  wrk_session = {};
+}
+
+Api::SysCallIntResult
+VclDatagramIoHandle::connect(Envoy::Network::Address::InstanceConstSharedPtr address) {
+  if (!VCL_SH_VALID(sh_)) {
+    return {-1, VPPCOM_EBADFD};
+  }
+  // Vpp pins the 5-tuple of connected UDP sessions, so it demuxes their datagrams by session
+  // lookup and vcl sends and receives them without per datagram endpoints
+  uint32_t len = 0;
+  int32_t rv = vppcom_session_attr(sh_, VPPCOM_ATTR_SET_CONNECTED, nullptr, &len);
+  if (rv < 0) {
+    return {-1, -rv};
+  }
+  Api::SysCallIntResult rc = VclIoHandle::connect(address);
+  if (rc.return_value_ == 0 || rc.errno_ == EINPROGRESS) {
+    connected_peer_ = address;
+  }
+  return rc;
+}
+
+Api::IoCallUint64Result
+VclDatagramIoHandle::sendmsg(const Buffer::RawSlice* slices, uint64_t num_slice, int,
+                             const Envoy::Network::Address::Ip*,
+                             const Envoy::Network::Address::Instance& peer_address) {
+  const uint32_t sh = ioSession();
+  if (!VCL_SH_VALID(sh)) {
+    return vclCallResultToIoCallResult(VPPCOM_EBADFD);
+  }
+
+  uint64_t num_slices_to_write = 0;
+  uint64_t num_bytes_to_write = 0;
+  const Buffer::RawSlice* slice = nullptr;
+  for (uint64_t i = 0; i < num_slice; i++) {
+    if (slices[i].mem_ != nullptr && slices[i].len_ != 0) {
+      slice = &slices[i];
+      num_bytes_to_write += slices[i].len_;
+      num_slices_to_write++;
+    }
+  }
+  if (num_slices_to_write == 0) {
+    return Api::ioCallUint64ResultNoError();
+  }
 
-  if (peekVclSession(sh_, &ep, &proto)) {
-    RELEASE_ASSERT(0, "");
+  // Every vcl write is a datagram, so slices are gathered into one
+  void* buf = slice->mem_;
+  absl::FixedArray<uint8_t, 2048> gathered(num_slices_to_write > 1 ? num_bytes_to_write : 0);
+  if (num_slices_to_write > 1) {
+    uint64_t offset = 0;
+    for (uint64_t i = 0; i < num_slice; i++) {
+      if (slices[i].mem_ != nullptr && slices[i].len_ != 0) {
+        memcpy(gathered.data() + offset, slices[i].mem_, slices[i].len_); // NOLINT(safe-memcpy)
+        offset += slices[i].len_;
+      }
+    }
+    buf = gathered.data();
+  }
+
+  int result;
+  if (connected_peer_ != nullptr) {
+    result = vppcom_session_write_msg(sh, buf, num_bytes_to_write);
+  } else {
+    vppcom_endpt_t endpt;
+    vclEndptFromAddress(endpt, peer_address);
+    result = vppcom_session_sendto(sh, buf, num_bytes_to_write, 0, &endpt);
   }
+  VCL_TRACE(SendMsg, sh_, 0, result);
 
-  auto address = vclEndptToAddress(ep, -1);
-  auto sh = vppcom_session_create(proto, 1);
-  IoHandlePtr io_handle = std::make_unique<VclIoHandle>(static_cast<uint32_t>(sh), 1 << 23);
+  return vclCallResultToIoCallResult(result);
+}
 
-  io_handle->bind(address);
+Api::IoCallUint64Result VclDatagramIoHandle::recvmsg(Buffer::RawSlice* slices,
+                                                     const uint64_t num_slice, uint32_t self_port,
+                                                     RecvMsgOutput& output) {
+  const uint32_t sh = ioSession();
+  if (!VCL_SH_VALID(sh)) {
+    return vclCallResultToIoCallResult(VPPCOM_EBADFD);
+  }
 
+  // A datagram per read, into the first slice it can go to. Vcl copies it out of the rx fifo.
+  Buffer::RawSlice* slice = nullptr;
+  for (uint64_t i = 0; i < num_slice; i++) {
+    if (slices[i].mem_ != nullptr && slices[i].len_ != 0) {
+      slice = &slices[i];
+      break;
+    }
+  }
+  if (slice == nullptr) {
+    return Api::ioCallUint64ResultNoError();
+  }
+
+  int result;
+  if (connected_peer_ != nullptr) {
+    // Peer is the one connected to
+    result = vppcom_session_recvfrom(sh, slice->mem_, slice->len_, 0, nullptr);
+    if (result >= 0) {
+      output.msg_[0].peer_address_ = connected_peer_;
+    }
+  } else {
+    uint8_t ipaddr[sizeof(absl::uint128)];
+    vppcom_endpt_t endpt;
+    endpt.ip = ipaddr;
+    endpt.port = static_cast<uint16_t>(self_port);
+    result = vppcom_session_recvfrom(sh, slice->mem_, slice->len_, 0, &endpt);
+    if (result >= 0) {
+      output.msg_[0].peer_address_ = vclEndptToAddress(endpt, sh);
+    }
+  }
+  if (result < 0) {
+    return vclCallResultToIoCallResult(result);
+  }
+
+  output.dropped_packets_ = nullptr;
+  VCL_TRACE(RecvMsg, sh_, 0, result);
+
+  return vclCallResultToIoCallResult(result);
+}
+
+IoHandlePtr VclDatagramIoHandle::duplicate() {
+  ENVOY_LOG(debug, "duplicating vcl session 0x{:x}", sh_);
+
+  if (!shared_sessions_) {
+    shared_sessions_ = std::make_shared<VclListenSessions>(sh_);
+  }
+  auto io_handle = std::make_unique<VclDatagramIoHandle>(sh_);
+  io_handle->shared_sessions_ = shared_sessions_;
+  // Bound on the worker the duplicate is used on
+  VCL_SET_SH_INVALID(io_handle->io_sh_);
   return io_handle;
 }
 
-absl::optional<std::chrono::milliseconds> VclIoHandle::lastRoundTripTime() { return {}; }
+void VclDatagramIoHandle::initializeFileEvent(Event::Dispatcher& dispatcher, Event::FileReadyCb cb,
+                                              Event::FileTriggerType trigger, uint32_t events) {
+  if (!shared_sessions_) {
+    VclIoHandle::initializeFileEvent(dispatcher, cb, trigger, events);
+    return;
+  }
+  VCL_TRACE(EventsInit, sh_, events, 0);
+
+  auto wrk_index = vcl_wrk_index_or_register();
+  vcl_interface_register_epoll_event(dispatcher);
+
+  // Take over the session of a duplicate, e.g., the listener being updated. The session is
+  // already in the worker's epoll set, only its events change.
+  auto& wrk_session = shared_sessions_->wrkListener(wrk_index);
+  const int epoll_op =
+      VCL_SH_VALID(wrk_session.sh) && wrk_session.owner != this ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+  const uint32_t sh = bindWrkSession();
+  if (!VCL_SH_VALID(sh)) {
+    return;
+  }
+
+  struct epoll_event ev;
+  ev.events = vclEpollEvents(events);
+  ev.data.u64 = reinterpret_cast<uint64_t>(this);
+
+  cb_ = cb;
+  events_ = events;
+  vppcom_epoll_ctl(vcl_epoll_handle(wrk_index), epoll_op, sh, &ev);
+  registerSession(wrk_index);
+
+  file_event_ = Event::FileEventPtr{new VclEvent(*this)};
+}
+
+void VclDatagramIoHandle::resetFileEvents() {
+  file_event_.reset();
+  if (!shared_sessions_) {
+    return;
+  }
+  // Worker sessions are valid only as long as the event is valid
+  releaseWrkSession();
+  unregisterSession();
+}
+
+void VclDatagramIoHandle::updateEvents(uint32_t events) {
+  VCL_TRACE(EventsUpdate, sh_, events, 0);
+  events_ = events;
+
+  struct epoll_event ev;
+  ev.events = vclEpollEvents(events);
+  ev.data.u64 = reinterpret_cast<uint64_t>(this);
+  vppcom_epoll_ctl(vcl_epoll_handle(vcl_wrk_index_or_register()), EPOLL_CTL_MOD, io_sh_, &ev);
+}
+
+void VclDatagramIoHandle::dumpState(std::ostream& os, MonotonicTime now) {
+  dumpSession(os, now, io_sh_);
+}
 
 } // namespace Vcl
 } // namespace Network
@@ -1,8 +1,13 @@
 #pragma once
 
+#include <array>
 #include <list>
+#include <ostream>
+#include <string>
+#include <vector>
 
 #include "envoy/api/io_error.h"
+#include "envoy/common/time.h"
 #include "envoy/network/io_handle.h"
 
 #include "source/common/common/logger.h"
@@ -21,25 +26,83 @@ using namespace Envoy::Network;
 #define VCL_SH_VALID(_sh) (_sh != static_cast<uint32_t>(~0))
 #define VCL_SET_SH_INVALID(_sh) (_sh = static_cast<uint32_t>(~0))
 
-int peekVclSession(vcl_session_handle_t sh, vppcom_endpt_t* ep, uint32_t* proto);
+class VclIoHandle;
+class VclReadyList;
+class VclListenerIoHandle;
+
+// Closes sh on the worker that owns it, right away if that's the calling worker.
+void closeVclSession(vcl_session_handle_t sh);
+// Dumps the state of all sessions registered with the calling worker.
+void vclDumpWorkerSessions(uint32_t wrk_index, MonotonicTime now, std::ostream& os);
 Envoy::Network::Address::InstanceConstSharedPtr vclEndptToAddress(const vppcom_endpt_t& endpt,
                                                                   uint32_t sh);
+void vclEndptCopy(sockaddr* addr, socklen_t* addrlen, const vppcom_endpt_t& ep);
+int vcl_wrk_index_or_register();
+uint32_t vclEpollEvents(uint32_t events);
+// Creates a vpp TLS or QUIC session using the cert/key pair of the TLS listeners on port.
+int vclTlsSessionCreate(uint16_t port);
 
-class VclIoHandle : public Envoy::Network::IoHandle, Logger::Loggable<Logger::Id::connection> {
+// Errnos with preallocated io errors. Vcl errors are negated errnos.
+constexpr uint32_t VclMaxIoErrno = 136;
+// Io error of a failed vcl call, counted for the calling worker. Errors come from a static table,
+// so error bursts, e.g., resets of all connections to a failed upstream, don't allocate.
+Api::IoErrorPtr vclIoError(int32_t result);
+// Errors with errno err returned across all workers.
+uint64_t vcl_io_errors(uint32_t err);
+// Stat name of errno err, e.g., econnreset.
+std::string vclIoErrorName(uint32_t err);
+
+// Vpp listen sessions shared by a listener and all its duplicates. Duplicates, e.g., sockets
+// cloned for other workers or for an updated listener, take over the per worker listen sessions
+// instead of binding new ones, so there's no window in which vpp refuses connections. UDP
+// listeners share their per worker bound sessions the same way.
+class VclListenSessions {
 public:
-  explicit VclIoHandle(os_fd_t fd = INVALID_SOCKET) : sh_(fd) {
-    fprintf(stderr, "copyconstructor?\n");
-  }
+  // Listen session owned by a worker and the handle its events are delivered to.
+  struct WrkListener {
+    uint32_t sh{VCL_INVALID_SH};
+    VclIoHandle* owner{nullptr};
+    // Duplicates with file events on the worker. QUIC connections outlive the listen session and
+    // are closed once the last of them goes away.
+    std::vector<VclListenerIoHandle*> listeners;
+    // QUIC connections accepted on the worker and the listener their events are delivered to.
+    std::vector<uint32_t> quic_connections;
+    VclListenerIoHandle* quic_owner{nullptr};
+  };
 
-  VclIoHandle(uint32_t sh, os_fd_t fd) : sh_(sh), fd_(fd) { (void)fd_; }
+  // Created on the worker that owns sh, whose endpoint and protocol are cached so other workers
+  // clone it without touching it.
+  explicit VclListenSessions(uint32_t sh);
+  ~VclListenSessions();
 
+  // Session created on the main thread that all worker listen sessions are cloned from.
+  uint32_t sh() const { return sh_; }
+  uint32_t proto() const { return proto_; }
+  // Endpoint sh is bound to. ep.ip is set to ip, which must fit an ip6 address.
+  void endpoint(vppcom_endpt_t& ep, uint8_t* ip) const;
+  // Listen session of worker wrk_index. Only accessed by that worker.
+  WrkListener& wrkListener(uint32_t wrk_index) { return wrk_listeners_[wrk_index]; }
+
+private:
+  uint32_t sh_;
+  uint32_t proto_{0};
+  vppcom_endpt_t endpoint_{};
+  uint8_t endpoint_ip_[16]{};
+  std::array<WrkListener, 128> wrk_listeners_;
+};
+
+using VclListenSessionsSharedPtr = std::shared_ptr<VclListenSessions>;
+
+// State and operations shared by all vcl sessions: the session itself, socket options, addresses
+// and file events. Data and listen paths live in the specialized handles, picked when a session
+// is created, so TCP sessions carry no UDP state and their data path takes no listener branches.
+class VclIoHandle : public Envoy::Network::IoHandle, Logger::Loggable<Logger::Id::connection> {
+public:
   ~VclIoHandle() override;
 
   os_fd_t fdDoNotUse() const override { return 1 << 23; }
 
   uint32_t sh() const { return sh_; }
-  bool isListener() const { return is_listener_; }
-  void setListener(bool is_listener) { is_listener_ = is_listener; }
 
   Api::IoCallUint64Result close() override;
 
@@ -77,46 +140,46 @@ public:
   absl::optional<int> domain() override;
   Envoy::Network::Address::InstanceConstSharedPtr localAddress() override;
   Envoy::Network::Address::InstanceConstSharedPtr peerAddress() override;
-  Api::SysCallIntResult shutdown(int) override { return {0, 0}; }
+  Api::SysCallIntResult shutdown(int how) override;
 
   void initializeFileEvent(Event::Dispatcher& dispatcher, Event::FileReadyCb cb,
                            Event::FileTriggerType trigger, uint32_t events) override;
   void activateFileEvents(uint32_t events) override { file_event_->activate(events); }
   void enableFileEvents(uint32_t events) override { file_event_->setEnabled(events); }
-  void resetFileEvents() override { file_event_.reset(); }
+  void resetFileEvents() override;
 
   void cb(uint32_t events) { cb_(events); }
-  void setCb(Event::FileReadyCb cb) { cb_ = cb; }
-  void updateEvents(uint32_t events);
+  virtual void updateEvents(uint32_t events);
 
-  IoHandlePtr duplicate() override;
+  // Writes a one line summary of the session, including fifo occupancy. Must run on the worker
+  // that owns the session.
+  virtual void dumpState(std::ostream& os, MonotonicTime now);
 
-  bool no_sh_ = false;
+protected:
+  explicit VclIoHandle(uint32_t sh) : sh_(sh) {}
 
-  void setChildWrkListener(VclIoHandle* parent_listener) {
-    is_wrk_listener_ = true;
-    parent_listener_ = parent_listener;
-  }
-  void clearChildWrkListener() {
-    if (wrk_listener_) {
-      wrk_listener_.release();
-      wrk_listener_ = nullptr;
-    }
-  }
-  VclIoHandle* getParentListener() { return parent_listener_; }
-  bool isWrkListener() { return is_wrk_listener_; }
+  // Summary of vpp session sh, which the handle does its io on.
+  void dumpSession(std::ostream& os, MonotonicTime now, uint32_t sh);
+
+  // Adds or removes the handle from the sessions of the worker it's registered with.
+  void registerSession(uint32_t wrk_index);
+  void unregisterSession();
+
+  friend class VclReadyList;
 
-private:
   uint32_t sh_{VCL_INVALID_SH};
-  os_fd_t fd_{~0};
   Event::FileEventPtr file_event_{nullptr};
+  Event::FileReadyCb cb_;
 
-  bool is_listener_ = false;
-  bool is_wrk_listener_ = false;
-  bool not_listened_ = false;
-  VclIoHandle* parent_listener_{nullptr};
-  std::unique_ptr<VclIoHandle> wrk_listener_{nullptr};
-
+  // Events pending delivery and position in the worker's ready list, or -1 if not queued.
+  uint32_t ready_events_{0};
+  int32_t ready_index_{-1};
+  // Requested events, time events were last delivered, and the worker whose sessions this handle
+  // is part of and its position there, or -1.
+  uint32_t events_{0};
+  MonotonicTime last_event_{};
+  int32_t registered_wrk_index_{-1};
+  int32_t session_index_{-1};
 
   // Converts a VCL return types to IoCallUint64Result.
   Api::IoCallUint64Result vclCallResultToIoCallResult(const int32_t result) {
@@ -125,16 +188,95 @@ private:
       return Api::IoCallUint64Result(
           result, Api::IoErrorPtr(nullptr, Envoy::Network::IoSocketError::deleteIoError));
     }
-    RELEASE_ASSERT(result != VPPCOM_EINVAL, "Invalid argument passed in.");
-    return Api::IoCallUint64Result(
-        /*rc=*/0, (result == VPPCOM_EAGAIN
-                       // EAGAIN is frequent enough that its memory allocation should be avoided.
-                       ? Api::IoErrorPtr(Envoy::Network::IoSocketError::getIoSocketEagainInstance(),
-                                         Envoy::Network::IoSocketError::deleteIoError)
-                       : Api::IoErrorPtr(new Envoy::Network::IoSocketError(-result),
-                                         Envoy::Network::IoSocketError::deleteIoError)));
+    return Api::IoCallUint64Result(/*rc=*/0, vclIoError(result));
   }
-  Event::FileReadyCb cb_;
+};
+
+// TCP session, accepted or connected.
+//
+// Envoy creates listen and connection sockets through the same SocketInterface::socket() call,
+// with the same socket type and an address that doesn't tell them apart, so the handle is picked
+// before the socket's role is known. A stream socket only turns out to be a listener once it's
+// listened on or duplicated. From then on this handle, which Envoy keeps for the socket, forwards
+// listen, accept, file events and close to the listener it created. Duplicates, i.e., the sockets
+// workers listen on, are listener handles themselves and never go through here.
+class VclStreamIoHandle : public VclIoHandle {
+public:
+  explicit VclStreamIoHandle(uint32_t sh) : VclIoHandle(sh) {}
+  ~VclStreamIoHandle() override;
+
+  Api::IoCallUint64Result close() override;
+  Api::IoCallUint64Result read(Buffer::Instance& buffer, absl::optional<uint64_t> max_length) override;
+  Api::SysCallIntResult bind(Envoy::Network::Address::InstanceConstSharedPtr address) override;
+  Api::SysCallIntResult connect(Envoy::Network::Address::InstanceConstSharedPtr address) override;
+  Api::SysCallIntResult listen(int backlog) override;
+  Envoy::Network::IoHandlePtr accept(struct sockaddr* addr, socklen_t* addrlen) override;
+  Api::SysCallIntResult setOption(int level, int optname, const void* optval,
+                                  socklen_t optlen) override;
+  Api::SysCallIntResult getOption(int level, int optname, void* optval, socklen_t* optlen) override;
+  void initializeFileEvent(Event::Dispatcher& dispatcher, Event::FileReadyCb cb,
+                           Event::FileTriggerType trigger, uint32_t events) override;
+  void resetFileEvents() override;
+  IoHandlePtr duplicate() override;
+
+  // Reads lend rx fifo segments to the buffer instead of copying them out, so data proxied to
+  // another vcl session is only copied once, into its tx fifo.
+  void enableZeroCopyRx() { zero_copy_rx_ = true; }
+
+private:
+  // Rx segments lent to buffers by zero copy reads. Buffers may outlive the handle, so the vpp
+  // session is closed once the handle is closed and the last segment is returned.
+  struct RxLease {
+    explicit RxLease(uint32_t sh) : sh(sh) {}
+    ~RxLease();
+    const uint32_t sh;
+    bool closed{false};
+  };
+
+  // SO_LINGER. Only recorded, since closes are graceful. Zero linger aborts are refused.
+  struct linger linger_ {};
+  // Set once the socket is listened on or duplicated, see above.
+  std::unique_ptr<VclListenerIoHandle> listener_;
+  bool zero_copy_rx_{false};
+  std::shared_ptr<RxLease> rx_lease_;
+};
+
+// UDP session. Duplicates, i.e., listen sockets cloned for workers, send and receive on a session
+// of their worker, bound to the same endpoint like worker listen sessions of TCP listeners.
+// Connected sessions, e.g., of upstream flows, are connected UDP sessions in vpp.
+class VclDatagramIoHandle : public VclIoHandle {
+public:
+  explicit VclDatagramIoHandle(uint32_t sh) : VclIoHandle(sh), io_sh_(sh) {}
+  ~VclDatagramIoHandle() override;
+
+  Api::IoCallUint64Result close() override;
+  Api::SysCallIntResult connect(Envoy::Network::Address::InstanceConstSharedPtr address) override;
+  Api::IoCallUint64Result sendmsg(const Buffer::RawSlice* slices, uint64_t num_slice, int flags,
+                                  const Envoy::Network::Address::Ip* self_ip,
+                                  const Envoy::Network::Address::Instance& peer_address) override;
+  Api::IoCallUint64Result recvmsg(Buffer::RawSlice* slices, const uint64_t num_slice,
+                                  uint32_t self_port, RecvMsgOutput& output) override;
+  void initializeFileEvent(Event::Dispatcher& dispatcher, Event::FileReadyCb cb,
+                           Event::FileTriggerType trigger, uint32_t events) override;
+  void resetFileEvents() override;
+  IoHandlePtr duplicate() override;
+  void updateEvents(uint32_t events) override;
+  void dumpState(std::ostream& os, MonotonicTime now) override;
+
+private:
+  // Session io goes to, bound on first use for duplicates. Invalid if closed or the bind failed.
+  uint32_t ioSession();
+  // Binds the calling worker's session to the shared endpoint, or takes over that of a duplicate.
+  uint32_t bindWrkSession();
+  // Closes the calling worker's session unless another duplicate took it over.
+  void releaseWrkSession();
+
+  VclListenSessionsSharedPtr shared_sessions_;
+  // Session datagrams are sent and received on: sh_, or for duplicates the session of the worker
+  // they're used on.
+  uint32_t io_sh_;
+  // Set once connected. Datagrams are then sent to and received from it only.
+  Envoy::Network::Address::InstanceConstSharedPtr connected_peer_;
 };
 
 } // namespace Vcl
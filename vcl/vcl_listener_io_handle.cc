@@ -0,0 +1,327 @@
+#include "vcl/vcl_listener_io_handle.h"
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+
+#include "vcl/vcl_event.h"
+#include "vcl/vcl_interface.h"
+#include "vcl/vcl_trace.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Network {
+namespace Vcl {
+
+VclListenerIoHandle::VclListenerIoHandle(uint32_t sh, VclListenSessionsSharedPtr listen_sessions)
+    : VclIoHandle(sh), listen_sessions_(listen_sessions
+                                            ? std::move(listen_sessions)
+                                            : std::make_shared<VclListenSessions>(sh)) {
+  quic_ = listen_sessions_->proto() == VPPCOM_PROTO_QUIC;
+
+  vppcom_endpt_t ep;
+  uint8_t addr_buf[sizeof(struct sockaddr_in6)];
+  listen_sessions_->endpoint(ep, addr_buf);
+  zero_copy_rx_ = vcl_zero_copy_port(ntohs(ep.port));
+}
+
+VclListenerIoHandle::~VclListenerIoHandle() {
+  if (isOpen()) {
+    VclListenerIoHandle::close();
+  }
+}
+
+Api::IoCallUint64Result VclListenerIoHandle::close() {
+  VCL_TRACE(Close, sh_, 0, 0);
+  RELEASE_ASSERT(VCL_SH_VALID(sh_), "sh must be valid");
+  auto wrk_index = vcl_wrk_index_or_register();
+  if (registered_wrk_index_ == wrk_index) {
+    unregisterSession();
+  }
+
+  // Vpp listen sessions are closed once the last duplicate lets go of them
+  releaseQuicConnections();
+  releaseWrkListener(wrk_index);
+  listen_sessions_.reset();
+  VCL_SET_SH_INVALID(sh_);
+
+  return Api::ioCallUint64ResultNoError();
+}
+
+Api::SysCallIntResult VclListenerIoHandle::listen(int) {
+  auto wrk_index = vcl_wrk_index_or_register();
+  RELEASE_ASSERT(wrk_index != -1, "should be initialized");
+
+  VCL_TRACE(Listen, sh_, 0, 0);
+  RELEASE_ASSERT(vppcom_session_worker(sh_) == wrk_index, "");
+
+  if (!wrk_index)
+    not_listened_ = true;
+
+  return {0, 0};
+}
+
+Envoy::Network::IoHandlePtr VclListenerIoHandle::accept(sockaddr* addr, socklen_t* addrlen) {
+  auto wrk_index = vcl_wrk_index_or_register();
+  RELEASE_ASSERT(wrk_index != -1, "must have worker");
+
+  auto sh = sh_;
+  if (wrk_index) {
+    sh = listen_sessions_->wrkListener(wrk_index).sh;
+  }
+
+  vppcom_endpt_t endpt;
+  sockaddr_storage ss;
+  endpt.ip = reinterpret_cast<uint8_t*>(&ss);
+  auto new_sh = ABSL_PREDICT_FALSE(quic_) ? acceptQuicStream(sh, wrk_index, endpt)
+                                          : vppcom_session_accept(sh, &endpt, O_NONBLOCK);
+  if (new_sh >= 0) {
+    vclEndptCopy(addr, addrlen, endpt);
+    VCL_TRACE(Accept, new_sh, 0, 0);
+    auto io_handle = std::make_unique<VclStreamIoHandle>(new_sh);
+    if (zero_copy_rx_) {
+      io_handle->enableZeroCopyRx();
+    }
+    return io_handle;
+  }
+  return nullptr;
+}
+
+bool VclListenerIoHandle::registerListener(Event::Dispatcher& dispatcher, Event::FileReadyCb cb,
+                                           uint32_t events) {
+  VCL_TRACE(EventsInit, sh_, events, 0);
+
+  auto wrk_index = vcl_wrk_index_or_register();
+  vcl_interface_register_epoll_event(dispatcher);
+
+  uint32_t sh = sh_;
+  int epoll_op = EPOLL_CTL_ADD;
+
+  // If this is not the main worker, make sure a worker listener exists
+  if (wrk_index) {
+    auto& wrk_listener = listen_sessions_->wrkListener(wrk_index);
+    if (VCL_SH_VALID(wrk_listener.sh)) {
+      // Take over the listen session of a duplicate, e.g., the listener being updated or
+      // drained. The session is already in the worker's epoll set, only its events change.
+      epoll_op = EPOLL_CTL_MOD;
+    } else if (!createWrkListener(wrk_index)) {
+      return false;
+    }
+    wrk_listener.owner = this;
+    sh = wrk_listener.sh;
+  // On main worker, no need to create worker listeners
+  } else if (not_listened_) {
+    vppcom_session_listen(sh_, 5);
+    not_listened_ = false;
+  }
+
+  // Worker listen sessions report their events straight to the listener
+  struct epoll_event ev;
+  ev.events = vclEpollEvents(events);
+  ev.data.u64 = reinterpret_cast<uint64_t>(this);
+
+  cb_ = cb;
+  if (quic_) {
+    // QUIC connections report new streams and hangups through the listener, both are handled by
+    // accepting
+    cb_ = [cb](uint32_t) { cb(Event::FileReadyType::Read); };
+  }
+  events_ = events;
+  vppcom_epoll_ctl(vcl_epoll_handle(wrk_index), epoll_op, sh, &ev);
+  registerSession(wrk_index);
+  if (listener_wrk_index_ < 0) {
+    listen_sessions_->wrkListener(wrk_index).listeners.push_back(this);
+    listener_wrk_index_ = wrk_index;
+  }
+  if (quic_) {
+    takeQuicConnections(wrk_index);
+  }
+  return true;
+}
+
+void VclListenerIoHandle::initializeFileEvent(Event::Dispatcher& dispatcher, Event::FileReadyCb cb,
+                                              Event::FileTriggerType, uint32_t events) {
+  if (registerListener(dispatcher, cb, events)) {
+    file_event_ = Event::FileEventPtr{new VclEvent(*this)};
+  }
+}
+
+void VclListenerIoHandle::resetFileEvents() {
+  file_event_.reset();
+  // Worker listen sessions are valid only as long as the event is valid
+  auto wrk_index = vcl_wrk_index_or_register();
+  releaseQuicConnections();
+  releaseWrkListener(wrk_index);
+  unregisterSession();
+}
+
+void VclListenerIoHandle::updateEvents(uint32_t events) {
+  auto wrk_index = vcl_wrk_index_or_register();
+  VCL_TRACE(EventsUpdate, sh_, events, 0);
+  events_ = events;
+
+  uint32_t sh = sh_;
+  if (wrk_index) {
+    sh = listen_sessions_->wrkListener(wrk_index).sh;
+  }
+
+  struct epoll_event ev;
+  ev.events = vclEpollEvents(events);
+  ev.data.u64 = reinterpret_cast<uint64_t>(this);
+
+  vppcom_epoll_ctl(vcl_epoll_handle(wrk_index), EPOLL_CTL_MOD, sh, &ev);
+}
+
+void VclListenerIoHandle::dumpState(std::ostream& os, MonotonicTime now) {
+  auto wrk_index = vppcom_worker_index();
+  const uint32_t sh = wrk_index ? listen_sessions_->wrkListener(wrk_index).sh : sh_;
+
+  os << fmt::format("  listener sh 0x{:x}", sh_);
+  if (!isOpen() || !VCL_SH_VALID(sh)) {
+    os << " closed\n";
+    return;
+  }
+  if (sh != sh_) {
+    os << fmt::format(" wrk sh 0x{:x}", sh);
+  }
+  os << fmt::format(" vpp session {} interest 0x{:x} pending 0x{:x}", vppcom_session_index(sh),
+                    events_, ready_events_);
+  if (last_event_ != MonotonicTime()) {
+    os << fmt::format(" last event {}ms ago",
+                      std::chrono::duration_cast<std::chrono::milliseconds>(now - last_event_)
+                          .count());
+  }
+  os << "\n";
+}
+
+bool VclListenerIoHandle::createWrkListener(uint32_t wrk_index) {
+  auto& wrk_listener = listen_sessions_->wrkListener(wrk_index);
+  vppcom_endpt_t ep;
+  uint8_t addr_buf[sizeof(struct sockaddr_in6)];
+  listen_sessions_->endpoint(ep, addr_buf);
+  const uint32_t proto = listen_sessions_->proto();
+
+  // Worker listen sessions of TLS listeners use the listener's cert/key pair
+  int sh = proto == VPPCOM_PROTO_TLS || proto == VPPCOM_PROTO_QUIC
+               ? vclTlsSessionCreate(ntohs(ep.port))
+               : vppcom_session_create(proto, 1);
+  if (sh < 0) {
+    ENVOY_LOG(error, "vcl worker {}: session create failed rv {}", wrk_index, sh);
+    return false;
+  }
+  int rv = vppcom_session_bind(sh, &ep);
+  if (!rv) {
+    rv = vppcom_session_listen(sh, 5);
+  }
+  if (rv) {
+    ENVOY_LOG(error, "vcl worker {}: listen failed sh 0x{:x} rv {}", wrk_index, sh, rv);
+    vppcom_session_close(sh);
+    return false;
+  }
+  wrk_listener.sh = sh;
+  return true;
+}
+
+int VclListenerIoHandle::acceptQuicStream(uint32_t listen_sh, uint32_t wrk_index,
+                                          vppcom_endpt_t& endpt) {
+  auto& quic_connections = listen_sessions_->wrkListener(wrk_index).quic_connections;
+  int sh;
+  while ((sh = vppcom_session_accept(listen_sh, &endpt, O_NONBLOCK)) >= 0) {
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.u64 = reinterpret_cast<uint64_t>(this);
+    vppcom_epoll_ctl(vcl_epoll_handle(wrk_index), EPOLL_CTL_ADD, sh, &ev);
+    quic_connections.push_back(sh);
+  }
+
+  // Connections are few per listener compared to their streams, so all are polled
+  for (auto it = quic_connections.begin(); it != quic_connections.end();) {
+    sh = vppcom_session_accept(*it, &endpt, O_NONBLOCK);
+    if (sh >= 0) {
+      return sh;
+    }
+    if (sh != VPPCOM_EAGAIN) {
+      // Connection closed by the peer, its streams are closed with it
+      VCL_TRACE(Close, *it, 0, sh);
+      vppcom_session_close(*it);
+      it = quic_connections.erase(it);
+      continue;
+    }
+    ++it;
+  }
+  return VPPCOM_EAGAIN;
+}
+
+void VclListenerIoHandle::takeQuicConnections(uint32_t wrk_index) {
+  auto& wrk_listener = listen_sessions_->wrkListener(wrk_index);
+  auto& quic_connections = wrk_listener.quic_connections;
+  wrk_listener.quic_owner = this;
+  if (quic_connections.empty()) {
+    return;
+  }
+  struct epoll_event ev;
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.u64 = reinterpret_cast<uint64_t>(this);
+  for (uint32_t sh : quic_connections) {
+    vppcom_epoll_ctl(vcl_epoll_handle(wrk_index), EPOLL_CTL_MOD, sh, &ev);
+  }
+  // Events already delivered to the previous owner may have been left unhandled
+  if (cb_) {
+    VCL_TRACE(Activate, sh_, Event::FileReadyType::Read, 0);
+    VclReadyList& ready_list = vcl_ready_list(wrk_index);
+    ready_list.add(*this, Event::FileReadyType::Read);
+    ready_list.scheduleDrain();
+  }
+}
+
+void VclListenerIoHandle::releaseQuicConnections() {
+  if (listener_wrk_index_ < 0) {
+    return;
+  }
+  const uint32_t wrk_index = listener_wrk_index_;
+  listener_wrk_index_ = -1;
+  auto& wrk_listener = listen_sessions_->wrkListener(wrk_index);
+  auto& listeners = wrk_listener.listeners;
+  listeners.erase(std::remove(listeners.begin(), listeners.end(), this), listeners.end());
+  // Another duplicate, e.g., the listener replacing this one on a drain or update, already took
+  // the connections over
+  if (wrk_listener.quic_owner != this) {
+    return;
+  }
+  wrk_listener.quic_owner = nullptr;
+  if (!listeners.empty()) {
+    listeners.back()->takeQuicConnections(wrk_index);
+    return;
+  }
+  // Streams still open on the connections are reset
+  for (uint32_t sh : wrk_listener.quic_connections) {
+    VCL_TRACE(Close, sh, 0, 0);
+    vppcom_session_close(sh);
+  }
+  wrk_listener.quic_connections.clear();
+}
+
+void VclListenerIoHandle::releaseWrkListener(uint32_t wrk_index) {
+  auto& wrk_listener = listen_sessions_->wrkListener(wrk_index);
+  if (!VCL_SH_VALID(wrk_listener.sh) || wrk_listener.owner != this) {
+    return;
+  }
+  VCL_TRACE(Close, wrk_listener.sh, 0, 0);
+  vppcom_session_close(wrk_listener.sh);
+  wrk_listener = {};
+}
+
+IoHandlePtr VclListenerIoHandle::duplicate() {
+  ENVOY_LOG(debug, "duplicating vcl session 0x{:x}", sh_);
+
+  // Duplicates share the vpp listen sessions and take them over on their worker when their file
+  // events are initialized. Nothing is closed or bound again.
+  auto io_handle = std::make_unique<VclListenerIoHandle>(sh_, listen_sessions_);
+  io_handle->not_listened_ = not_listened_;
+  return io_handle;
+}
+
+} // namespace Vcl
+} // namespace Network
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+
+#include "vcl/vcl_io_handle.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Network {
+namespace Vcl {
+
+// Listener. The session created on the main thread is only listened on by the main worker, every
+// other worker accepts from its own listen session, cloned from the main one and shared with the
+// listener's duplicates.
+class VclListenerIoHandle : public VclIoHandle {
+public:
+  // Shares listen_sessions with the listener's duplicates, or starts a new set if null.
+  VclListenerIoHandle(uint32_t sh, VclListenSessionsSharedPtr listen_sessions);
+  ~VclListenerIoHandle() override;
+
+  Api::IoCallUint64Result close() override;
+  Api::SysCallIntResult listen(int backlog) override;
+  Envoy::Network::IoHandlePtr accept(struct sockaddr* addr, socklen_t* addrlen) override;
+  void initializeFileEvent(Event::Dispatcher& dispatcher, Event::FileReadyCb cb,
+                           Event::FileTriggerType trigger, uint32_t events) override;
+  void resetFileEvents() override;
+  IoHandlePtr duplicate() override;
+  void updateEvents(uint32_t events) override;
+  void dumpState(std::ostream& os, MonotonicTime now) override;
+
+  // Starts listening on the calling worker, creating or taking over its listen session, and
+  // delivers events to cb. Returns false if the worker can't listen.
+  bool registerListener(Event::Dispatcher& dispatcher, Event::FileReadyCb cb, uint32_t events);
+
+private:
+  // Closes the current worker's listen session unless another duplicate took it over.
+  void releaseWrkListener(uint32_t wrk_index);
+  // Creates and starts the current worker's listen session.
+  bool createWrkListener(uint32_t wrk_index);
+  // QUIC listen sessions accept connections and streams are accepted from those. Accepts new
+  // connections, then returns a stream of any of the worker's connections, or a vcl error.
+  int acceptQuicStream(uint32_t listen_sh, uint32_t wrk_index, vppcom_endpt_t& endpt);
+  // Delivers the events of the worker's QUIC connections to this listener.
+  void takeQuicConnections(uint32_t wrk_index);
+  // Drops this listener from the worker's duplicates, handing its QUIC connections to the others
+  // or closing them if it was the last.
+  void releaseQuicConnections();
+
+  VclListenSessionsSharedPtr listen_sessions_;
+  bool not_listened_ = false;
+  bool quic_ = false;
+  bool zero_copy_rx_ = false;
+  // Worker this listener counts as a duplicate on, or -1.
+  int32_t listener_wrk_index_ = -1;
+};
+
+} // namespace Vcl
+} // namespace Network
+} // namespace Extensions
+} // namespace Envoy
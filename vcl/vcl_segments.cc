@@ -0,0 +1,298 @@
+#include "vcl/vcl_segments.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "envoy/common/exception.h"
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_replace.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+
+#include "vcl/vcl_interface.h"
+#include "vcl/vcl_io_handle.h"
+#include "vpp/include/vcl/vppcom.h"
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+namespace Envoy {
+namespace Extensions {
+namespace Network {
+namespace Vcl {
+
+static constexpr char MemfdPrefix[] = "/memfd:";
+static bool prefault_segments = false;
+// Vcl config written with the fifo segment settings, and the VCL_CONFIG it replaced
+static std::string segments_config;
+static absl::optional<std::string> replaced_vcl_config;
+static std::atomic<uint64_t> alloc_failures{0};
+// Indexed by vcl worker index, written by the worker on refresh
+static std::atomic<uint64_t> worker_fifo_capacity[128];
+
+void vcl_segment_alloc_failed() { alloc_failures.fetch_add(1, std::memory_order_relaxed); }
+
+std::vector<VclSegment> vclMappedSegments(bool resident) {
+  std::vector<VclSegment> segments;
+  std::ifstream maps("/proc/self/maps");
+  std::string line;
+  const long page_size = sysconf(_SC_PAGESIZE);
+  while (std::getline(maps, line)) {
+    // start-end perms offset dev inode path
+    std::vector<absl::string_view> fields = absl::StrSplit(line, ' ', absl::SkipEmpty());
+    if (fields.size() < 6 || fields[1].size() < 4 || fields[1][3] != 's' ||
+        !absl::StartsWith(fields[5], MemfdPrefix)) {
+      continue;
+    }
+    std::pair<absl::string_view, absl::string_view> range = absl::StrSplit(fields[0], '-');
+    uint64_t start, end;
+    if (!absl::SimpleHexAtoi(range.first, &start) || !absl::SimpleHexAtoi(range.second, &end)) {
+      continue;
+    }
+    VclSegment segment{std::string(absl::StripPrefix(fields[5], MemfdPrefix)), start, end - start,
+                       0};
+    if (resident) {
+      std::vector<unsigned char> pages((segment.size + page_size - 1) / page_size);
+      if (mincore(reinterpret_cast<void*>(start), segment.size, pages.data()) == 0) {
+        for (unsigned char page : pages) {
+          segment.resident += (page & 1) ? page_size : 0;
+        }
+      }
+    }
+    segments.push_back(std::move(segment));
+  }
+  return segments;
+}
+
+void vclApplyFifoSegmentsConfig(
+    const envoy::extensions::network::socket_interface::v3::VclSocketInterface::FifoSegments&
+        config,
+    Filesystem::Instance& file_system) {
+  prefault_segments = config.prefault();
+
+  std::vector<std::string> settings;
+  if (config.segment_size()) {
+    settings.push_back(fmt::format("segment-size {}", config.segment_size()));
+  }
+  if (config.add_segment_size()) {
+    settings.push_back(fmt::format("add-segment-size {}", config.add_segment_size()));
+  }
+  if (config.rx_fifo_size()) {
+    settings.push_back(fmt::format("rx-fifo-size {}", config.rx_fifo_size()));
+  }
+  if (config.tx_fifo_size()) {
+    settings.push_back(fmt::format("tx-fifo-size {}", config.tx_fifo_size()));
+  }
+  if (config.hugepages()) {
+    settings.push_back("huge_page");
+  }
+  if (settings.empty()) {
+    return;
+  }
+
+  const char* env_path = getenv(VPPCOM_ENV_CONF);
+  const std::string path = env_path ? env_path : VPPCOM_CONF_DEFAULT;
+  const std::string vcl_config = file_system.fileReadToEnd(path);
+  // Settings overridden are dropped and the rest of the config is kept as is
+  std::string output;
+  bool in_vcl = false;
+  for (absl::string_view line : absl::StrSplit(vcl_config, '\n')) {
+    absl::string_view stripped = absl::StripLeadingAsciiWhitespace(line);
+    std::vector<absl::string_view> tokens = absl::StrSplit(stripped, ' ', absl::SkipEmpty());
+    const absl::string_view key = tokens.empty() ? "" : tokens[0];
+    if (key == "segment-size" || key == "add-segment-size" || key == "rx-fifo-size" ||
+        key == "tx-fifo-size" || key == "huge_page") {
+      continue;
+    }
+    absl::StrAppend(&output, line, "\n");
+    if (!in_vcl && absl::StartsWith(stripped, "vcl") && absl::StrContains(stripped, "{")) {
+      in_vcl = true;
+      for (const auto& setting : settings) {
+        absl::StrAppend(&output, "  ", setting, "\n");
+      }
+    }
+  }
+  if (!in_vcl) {
+    throw EnvoyException(fmt::format("vcl: no vcl section in {}", path));
+  }
+
+  const char* tmp_dir = getenv("TMPDIR");
+  const std::string dir =
+      !config.config_dir().empty() ? config.config_dir() : (tmp_dir ? tmp_dir : "/tmp");
+  // Random name, created exclusively and only readable by envoy, so links or files planted in a
+  // shared dir are never followed or reused
+  std::string path = absl::StrCat(dir, "/envoy-vcl-XXXXXX");
+  const int fd = mkstemp(path.data());
+  if (fd < 0) {
+    throw EnvoyException(
+        fmt::format("vcl: failed to create vcl config in {}: {}", dir, strerror(errno)));
+  }
+  absl::string_view remaining = output;
+  while (!remaining.empty()) {
+    const ssize_t rv = write(fd, remaining.data(), remaining.size());
+    if (rv < 0 && errno == EINTR) {
+      continue;
+    }
+    if (rv <= 0) {
+      close(fd);
+      unlink(path.c_str());
+      throw EnvoyException(fmt::format("vcl: failed to write {}", path));
+    }
+    remaining.remove_prefix(rv);
+  }
+  close(fd);
+  segments_config = std::move(path);
+  if (env_path) {
+    replaced_vcl_config = env_path;
+  }
+  setenv(VPPCOM_ENV_CONF, segments_config.c_str(), 1);
+}
+
+void vclRemoveFifoSegmentsConfig() {
+  if (segments_config.empty()) {
+    return;
+  }
+  unlink(segments_config.c_str());
+  segments_config.clear();
+  if (replaced_vcl_config.has_value()) {
+    setenv(VPPCOM_ENV_CONF, replaced_vcl_config->c_str(), 1);
+  } else {
+    unsetenv(VPPCOM_ENV_CONF);
+  }
+}
+
+void vclPrefaultSegments() {
+  if (!prefault_segments) {
+    return;
+  }
+  // Workers register in parallel
+  static absl::Mutex mutex;
+  static absl::flat_hash_set<uintptr_t> prefaulted;
+  absl::MutexLock lock(&mutex);
+
+  const long page_size = sysconf(_SC_PAGESIZE);
+  for (const VclSegment& segment : vclMappedSegments(false)) {
+    if (!prefaulted.insert(segment.start).second) {
+      continue;
+    }
+    void* start = reinterpret_cast<void*>(segment.start);
+    if (madvise(start, segment.size, MADV_POPULATE_WRITE) == 0) {
+      continue;
+    }
+    // Kernels older than 5.14. Read faults map the shared pages without touching their contents.
+    volatile const uint8_t* p = static_cast<const uint8_t*>(start);
+    for (uint64_t offset = 0; offset < segment.size; offset += page_size) {
+      (void)p[offset];
+    }
+  }
+}
+
+VclSegmentStats::VclSegmentStats(Event::Dispatcher& main_dispatcher, Stats::Scope& scope,
+                                 ThreadLocal::Slot& slot, std::chrono::milliseconds interval)
+    : scope_(scope.createScope("vcl.segments.")), slot_(slot), interval_(interval),
+      timer_(main_dispatcher.createTimer([this]() { refresh(); })) {
+  refresh();
+}
+
+void VclSegmentStats::refresh() {
+  slot_.runOnAllThreads(
+      [](OptRef<ThreadLocal::ThreadLocalObject>) {
+        const int wrk_index = vppcom_worker_index();
+        if (wrk_index < 0) {
+          return;
+        }
+        uint64_t bytes = 0;
+        for (VclIoHandle* io_handle : vcl_worker_sessions(wrk_index)) {
+          // Listen sessions shared with other workers belong to the worker that bound them
+          if (vppcom_session_worker(io_handle->sh()) != wrk_index) {
+            continue;
+          }
+          uint32_t fifo_len = 0;
+          uint32_t len = sizeof(fifo_len);
+          if (vppcom_session_attr(io_handle->sh(), VPPCOM_ATTR_GET_RX_FIFO_LEN, &fifo_len,
+                                  &len) == VPPCOM_OK) {
+            bytes += fifo_len;
+          }
+          fifo_len = 0;
+          len = sizeof(fifo_len);
+          if (vppcom_session_attr(io_handle->sh(), VPPCOM_ATTR_GET_TX_FIFO_LEN, &fifo_len,
+                                  &len) == VPPCOM_OK) {
+            bytes += fifo_len;
+          }
+        }
+        worker_fifo_capacity[wrk_index].store(bytes, std::memory_order_relaxed);
+      },
+      [this]() { publish(); });
+}
+
+void VclSegmentStats::publish() {
+  // Segments vpp added since, once workers' segments filled up
+  vclPrefaultSegments();
+  std::vector<std::string> segment_names;
+  absl::flat_hash_map<std::string, VclSegment> segments;
+  for (VclSegment& segment : vclMappedSegments(true)) {
+    // Names are made of the app and segment names, e.g., envoy-segment-0, and tag free
+    const std::string name = absl::StrReplaceAll(segment.name, {{".", "_"}, {" ", "_"}});
+    auto it = segments.find(name);
+    if (it == segments.end()) {
+      segment_names.push_back(name);
+      segments.emplace(name, std::move(segment));
+      continue;
+    }
+    // Segments mapped more than once, e.g., per worker mq segments
+    it->second.size += segment.size;
+    it->second.resident += segment.resident;
+  }
+  for (const auto& name : segment_names_) {
+    if (!segments.contains(name)) {
+      gauge(name + ".size_bytes").set(0);
+      gauge(name + ".resident_bytes").set(0);
+    }
+  }
+  for (const auto& name : segment_names) {
+    gauge(name + ".size_bytes").set(segments[name].size);
+    gauge(name + ".resident_bytes").set(segments[name].resident);
+  }
+  segment_names_ = std::move(segment_names);
+  gauge("mapped").set(segments.size());
+
+  for (uint32_t i = 0; i < 128; i++) {
+    const uint64_t bytes = worker_fifo_capacity[i].load(std::memory_order_relaxed);
+    const std::string name = fmt::format("worker_{}.fifo_capacity_bytes", i);
+    if (bytes || gauges_.contains(name)) {
+      gauge(name).set(bytes);
+    }
+  }
+  gauge("alloc_failures").set(alloc_failures.load(std::memory_order_relaxed));
+  timer_->enableTimer(interval_);
+}
+
+Stats::Gauge& VclSegmentStats::gauge(const std::string& name) {
+  auto it = gauges_.find(name);
+  if (it == gauges_.end()) {
+    it = gauges_
+             .emplace(name,
+                      &scope_->gaugeFromString(name, Stats::Gauge::ImportMode::NeverImport))
+             .first;
+  }
+  return *it->second;
+}
+
+} // namespace Vcl
+} // namespace Network
+} // namespace Extensions
+} // namespace Envoy
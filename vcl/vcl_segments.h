@@ -0,0 +1,84 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "envoy/event/dispatcher.h"
+#include "envoy/event/timer.h"
+#include "envoy/filesystem/filesystem.h"
+#include "envoy/stats/scope.h"
+#include "envoy/thread_local/thread_local.h"
+
+#include "source/common/common/logger.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "vcl/vcl_socket_interface.pb.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Network {
+namespace Vcl {
+
+// Shared memory segment vcl mapped, i.e., a fifo or mq segment.
+struct VclSegment {
+  // Name vpp created the segment's memfd with
+  std::string name;
+  uintptr_t start;
+  uint64_t size;
+  // Bytes of the segment backed by memory. Only filled in if asked for.
+  uint64_t resident;
+};
+
+// Segments currently mapped by the process, from /proc/self/maps.
+std::vector<VclSegment> vclMappedSegments(bool resident);
+
+// Writes the vcl config with the fifo segment settings of config applied and points VCL_CONFIG at
+// it, so vcl reads it when the app attaches. Throws if the vcl config can't be read or written.
+// The file is private to envoy and removed by vclRemoveFifoSegmentsConfig.
+void vclApplyFifoSegmentsConfig(
+    const envoy::extensions::network::socket_interface::v3::VclSocketInterface::FifoSegments&
+        config,
+    Filesystem::Instance& file_system);
+
+// Removes the vcl config written for the fifo segment settings and restores VCL_CONFIG. Vcl only
+// reads its config when the app attaches, so called right after.
+void vclRemoveFifoSegmentsConfig();
+
+// Faults in all pages of segments mapped since the last call, if fifo segments are to be
+// pre-faulted. Called once the app attaches and whenever a worker registers, since vpp creates
+// fifo segments per vcl worker, and when segment stats are published, for segments vpp added.
+void vclPrefaultSegments();
+
+// Sessions vcl failed to allocate, e.g., because the app's segments are out of space.
+void vcl_segment_alloc_failed();
+
+// Periodically publishes segment usage under vcl.segments.: per segment size and resident bytes,
+// per worker capacity of the fifos of the worker's sessions, and allocation failures. Workers sum
+// their fifo sizes between event loop iterations.
+class VclSegmentStats : Logger::Loggable<Logger::Id::main> {
+public:
+  VclSegmentStats(Event::Dispatcher& main_dispatcher, Stats::Scope& scope,
+                  ThreadLocal::Slot& slot, std::chrono::milliseconds interval);
+
+private:
+  void refresh();
+  void publish();
+  Stats::Gauge& gauge(const std::string& name);
+
+  Stats::ScopePtr scope_;
+  ThreadLocal::Slot& slot_;
+  const std::chrono::milliseconds interval_;
+  Event::TimerPtr timer_;
+  absl::flat_hash_map<std::string, Stats::Gauge*> gauges_;
+  // Segments published by the last refresh, zeroed once unmapped
+  std::vector<std::string> segment_names_;
+};
+
+using VclSegmentStatsPtr = std::unique_ptr<VclSegmentStats>;
+
+} // namespace Vcl
+} // namespace Network
+} // namespace Extensions
+} // namespace Envoy
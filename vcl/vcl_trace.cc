@@ -0,0 +1,301 @@
+#include "vcl/vcl_trace.h"
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "source/common/common/assert.h"
+#include "source/common/common/logger.h"
+#include "source/common/signal/fatal_error_handler.h"
+
+#include "absl/synchronization/mutex.h"
+#include "fmt/format.h"
+#include "vpp/include/vcl/vppcom.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Network {
+namespace Vcl {
+
+std::atomic<bool> vcl_trace_enabled{false};
+
+namespace {
+
+constexpr uint32_t MaxWorkers = 128;
+// 24 MiB of records per worker
+constexpr uint32_t MaxRingSize = 1 << 20;
+
+inline uint64_t vclTraceTimestamp() {
+#if defined(__x86_64__)
+  return __rdtsc();
+#elif defined(__aarch64__)
+  uint64_t vct;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(vct));
+  return vct;
+#else
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// Single producer ring, written only by its worker.
+struct VclTraceRing {
+  explicit VclTraceRing(uint32_t n_records)
+      : mask_(n_records - 1), records_(new VclTraceRecord[n_records]()) {}
+
+  const uint32_t mask_;
+  std::unique_ptr<VclTraceRecord[]> records_;
+  std::atomic<uint64_t> head_{0};
+};
+
+std::atomic<VclTraceRing*> trace_rings[MaxWorkers];
+std::atomic<uint32_t> ring_size{4096};
+std::atomic<bool> ring_enabled{false};
+
+// Per worker capture file and buffered records. Only touched by the worker.
+struct VclCapture {
+  int fd{-1};
+  std::vector<VclTraceRecord> records;
+};
+
+constexpr uint32_t CaptureBatch = 4096;
+
+VclCapture captures[MaxWorkers];
+std::atomic<bool> capture_enabled{false};
+// Set by the admin thread, read by workers when they open their files
+absl::Mutex capture_lock;
+std::string capture_prefix ABSL_GUARDED_BY(capture_lock);
+
+void updateTraceEnabled() {
+  vcl_trace_enabled.store(ring_enabled.load() || capture_enabled.load(),
+                          std::memory_order_relaxed);
+}
+
+uint64_t measureTicksPerSec() {
+  const auto start = std::chrono::steady_clock::now();
+  const uint64_t start_ticks = vclTraceTimestamp();
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  const uint64_t ticks = vclTraceTimestamp() - start_ticks;
+  const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+  return ns ? ticks * 1000000000 / ns : 0;
+}
+
+uint64_t ticksPerSec() {
+  static const uint64_t ticks_per_sec = measureTicksPerSec();
+  return ticks_per_sec;
+}
+
+void captureAdd(uint32_t wrk_index, const VclTraceRecord& record) {
+  VclCapture& capture = captures[wrk_index];
+  if (ABSL_PREDICT_FALSE(capture.fd < 0)) {
+    std::string path;
+    {
+      absl::MutexLock lock(&capture_lock);
+      path = fmt::format("{}.{}", capture_prefix, wrk_index);
+    }
+    capture.fd = open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (capture.fd < 0) {
+      return;
+    }
+    VclCaptureHeader header{VclCaptureHeader::Magic, VclCaptureHeader::Version,
+                            ticksPerSec(), wrk_index, sizeof(VclTraceRecord)};
+    if (write(capture.fd, &header, sizeof(header)) != sizeof(header)) {
+      close(capture.fd);
+      capture.fd = -1;
+      return;
+    }
+    capture.records.reserve(CaptureBatch);
+  }
+  capture.records.push_back(record);
+  if (capture.records.size() >= CaptureBatch) {
+    vclCaptureFlush(wrk_index);
+  }
+}
+
+class VclTraceFatalHandler : public FatalErrorHandlerInterface {
+public:
+  void onFatalError(std::ostream& os) const override {
+    int wrk_index = vppcom_worker_index();
+    if (wrk_index >= 0) {
+      vclTraceDump(wrk_index, os);
+    }
+  }
+  void runFatalActionsOnTrackedObject(const FatalAction::FatalActionPtrList&) const override {}
+};
+
+} // namespace
+
+void vclTraceSetRingSize(uint32_t n_records) {
+  n_records = std::min(n_records, MaxRingSize);
+  uint32_t size = 1;
+  while (size < n_records) {
+    size <<= 1;
+  }
+  ring_size.store(size);
+}
+
+void vclTraceEnable(bool enable) {
+  ring_enabled.store(enable);
+  updateTraceEnabled();
+}
+
+bool vclTraceRingEnabled() { return ring_enabled.load(std::memory_order_relaxed); }
+
+void vclTraceCalibrate() { ticksPerSec(); }
+
+void vclCaptureStart(const std::string& path_prefix) {
+  {
+    absl::MutexLock lock(&capture_lock);
+    capture_prefix = path_prefix;
+  }
+  capture_enabled.store(true);
+  updateTraceEnabled();
+}
+
+void vclCaptureStop() {
+  capture_enabled.store(false);
+  updateTraceEnabled();
+}
+
+bool vclCaptureEnabled() { return capture_enabled.load(std::memory_order_relaxed); }
+
+void vclCaptureFlush(uint32_t wrk_index) {
+  VclCapture& capture = captures[wrk_index];
+  if (capture.fd < 0) {
+    return;
+  }
+  const size_t len = capture.records.size() * sizeof(VclTraceRecord);
+  if (len && write(capture.fd, capture.records.data(), len) != static_cast<ssize_t>(len)) {
+    ENVOY_LOG_MISC(warn, "vcl worker {}: failed to write capture records", wrk_index);
+  }
+  capture.records.clear();
+  if (!vclCaptureEnabled()) {
+    close(capture.fd);
+    capture.fd = -1;
+  }
+}
+
+void vclCaptureFlushAll() {
+  for (uint32_t i = 0; i < MaxWorkers; i++) {
+    vclCaptureFlush(i);
+  }
+}
+
+void vclTraceAdd(VclTraceType type, uint32_t sh, uint32_t events, int32_t bytes) {
+  int wrk_index = vppcom_worker_index();
+  if (wrk_index < 0 || wrk_index >= static_cast<int>(MaxWorkers)) {
+    return;
+  }
+  const uint64_t timestamp = vclTraceTimestamp();
+
+  if (vclCaptureEnabled()) {
+    captureAdd(wrk_index, {timestamp, sh, events, bytes, type});
+  }
+  if (!vclTraceRingEnabled()) {
+    return;
+  }
+
+  VclTraceRing* ring = trace_rings[wrk_index].load(std::memory_order_acquire);
+  if (ABSL_PREDICT_FALSE(ring == nullptr)) {
+    // Rings are never freed, so dumps from other threads never race with a free
+    ring = new VclTraceRing(ring_size.load());
+    trace_rings[wrk_index].store(ring, std::memory_order_release);
+  }
+
+  const uint64_t head = ring->head_.load(std::memory_order_relaxed);
+  VclTraceRecord& record = ring->records_[head & ring->mask_];
+  record.timestamp = timestamp;
+  record.sh = sh;
+  record.events = events;
+  record.bytes = bytes;
+  record.type = type;
+  ring->head_.store(head + 1, std::memory_order_release);
+}
+
+void vclTraceDump(uint32_t wrk_index, std::ostream& os) {
+  VclTraceRing* ring = trace_rings[wrk_index].load(std::memory_order_acquire);
+  if (ring == nullptr) {
+    return;
+  }
+  const uint64_t head = ring->head_.load(std::memory_order_acquire);
+  const uint64_t n_records = std::min<uint64_t>(head, ring->mask_ + 1);
+  os << fmt::format("vcl worker {} trace: {} records, {} total\n", wrk_index, n_records, head);
+  uint64_t prev = 0;
+  for (uint64_t i = head - n_records; i < head; i++) {
+    const VclTraceRecord& record = ring->records_[i & ring->mask_];
+    os << fmt::format("  [{}] tsc {} (+{}) {} sh 0x{:x} events 0x{:x} bytes {}\n", wrk_index,
+                      record.timestamp, prev ? record.timestamp - prev : 0,
+                      vclTraceTypeName(record.type), record.sh, record.events, record.bytes);
+    prev = record.timestamp;
+  }
+}
+
+void vclTraceDumpAll(std::ostream& os) {
+  for (uint32_t i = 0; i < MaxWorkers; i++) {
+    vclTraceDump(i, os);
+  }
+}
+
+void vclTraceRegisterFatalHandler() {
+  // Fatal error handlers are process wide. The one handler dumps the ring of whichever worker
+  // crashes, so it's registered once.
+  static std::once_flag registered;
+  std::call_once(registered, []() {
+    static const VclTraceFatalHandler handler;
+    FatalErrorHandler::registerFatalErrorHandler(handler);
+  });
+}
+
+const char* vclTraceTypeName(VclTraceType type) {
+  switch (type) {
+  case VclTraceType::MqEvents:
+    return "mq-events";
+  case VclTraceType::EpollEvent:
+    return "epoll-event";
+  case VclTraceType::Activate:
+    return "activate";
+  case VclTraceType::Deliver:
+    return "deliver";
+  case VclTraceType::Read:
+    return "read";
+  case VclTraceType::Write:
+    return "write";
+  case VclTraceType::Recv:
+    return "recv";
+  case VclTraceType::SendMsg:
+    return "sendmsg";
+  case VclTraceType::RecvMsg:
+    return "recvmsg";
+  case VclTraceType::Accept:
+    return "accept";
+  case VclTraceType::Connect:
+    return "connect";
+  case VclTraceType::Listen:
+    return "listen";
+  case VclTraceType::Close:
+    return "close";
+  case VclTraceType::EventsInit:
+    return "events-init";
+  case VclTraceType::EventsUpdate:
+    return "events-update";
+  case VclTraceType::Shutdown:
+    return "shutdown";
+  }
+  return "unknown";
+}
+
+} // namespace Vcl
+} // namespace Network
+} // namespace Extensions
+} // namespace Envoy
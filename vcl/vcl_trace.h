@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "absl/base/optimization.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Network {
+namespace Vcl {
+
+enum class VclTraceType : uint8_t {
+  MqEvents,
+  EpollEvent,
+  Activate,
+  Deliver,
+  Read,
+  Write,
+  Recv,
+  SendMsg,
+  RecvMsg,
+  Accept,
+  Connect,
+  Listen,
+  Close,
+  EventsInit,
+  EventsUpdate,
+  Shutdown,
+};
+
+// Fixed size binary trace record. Fields that don't apply to a record type are 0.
+struct VclTraceRecord {
+  // Cpu timestamp counter
+  uint64_t timestamp;
+  uint32_t sh;
+  // FileReadyType events, or epoll events for EpollEvent records
+  uint32_t events;
+  // Bytes moved, or negative vcl error
+  int32_t bytes;
+  VclTraceType type;
+};
+
+static_assert(sizeof(VclTraceRecord) == 24, "trace records should stay compact");
+
+// Capture files, one per worker, start with this header followed by VclTraceRecords.
+struct VclCaptureHeader {
+  static constexpr uint32_t Magic = 0x434c4356; // "VCLC"
+  static constexpr uint32_t Version = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  // Timestamp counter ticks per second, measured when the capture started
+  uint64_t ticks_per_sec;
+  uint32_t wrk_index;
+  uint32_t record_size;
+};
+
+// True if records are kept in rings or captured to files.
+extern std::atomic<bool> vcl_trace_enabled;
+
+inline bool vclTraceEnabled() { return vcl_trace_enabled.load(std::memory_order_relaxed); }
+
+// Sets the number of records kept per worker, rounded up to a power of 2 and capped at 2^20. Only
+// affects rings not yet allocated.
+void vclTraceSetRingSize(uint32_t n_records);
+void vclTraceEnable(bool enable);
+bool vclTraceRingEnabled();
+// Appends a record to the calling worker's ring. Only the worker writes to its ring.
+void vclTraceAdd(VclTraceType type, uint32_t sh, uint32_t events, int32_t bytes);
+// Dumps the ring of one worker, oldest record first. Records written concurrently by the worker
+// may be torn, which is acceptable for debugging.
+void vclTraceDump(uint32_t wrk_index, std::ostream& os);
+void vclTraceDumpAll(std::ostream& os);
+// Registers a fatal error handler that dumps the crashing worker's ring. Only the first call
+// registers.
+void vclTraceRegisterFatalHandler();
+
+// Measures the timestamp counter frequency that capture headers carry. Takes 10ms, so done once
+// at bootstrap rather than when captures start.
+void vclTraceCalibrate();
+
+// Starts appending every trace record to <path_prefix>.<worker index>, for offline replay with
+// //vcl/replay:vcl_replay. Workers open their files on their first record.
+void vclCaptureStart(const std::string& path_prefix);
+void vclCaptureStop();
+bool vclCaptureEnabled();
+// Writes out the calling worker's buffered records. Must run on the worker, or once all workers
+// have exited.
+void vclCaptureFlush(uint32_t wrk_index);
+void vclCaptureFlushAll();
+
+const char* vclTraceTypeName(VclTraceType type);
+
+#define VCL_TRACE(_type, _sh, _events, _bytes)                                                     \
+  do {                                                                                             \
+    if (ABSL_PREDICT_FALSE(vclTraceEnabled())) {                                                   \
+      vclTraceAdd(VclTraceType::_type, _sh, _events, _bytes);                                      \
+    }                                                                                              \
+  } while (0)
+
+} // namespace Vcl
+} // namespace Network
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,224 @@
+#include "vcl/vcl_vpp_stats.h"
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+
+#include "source/common/common/macros.h"
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/strip.h"
+
+extern "C" {
+#include "vpp/include/vpp-api/client/stat_client.h"
+}
+
+namespace Envoy {
+namespace Extensions {
+namespace Network {
+namespace Vcl {
+
+static constexpr char DefaultStatsSocket[] = "/run/vpp/stats.sock";
+static constexpr std::chrono::milliseconds DefaultInterval{10000};
+
+// Session layer, TCP and node error counters, plus vpp's system stats
+static const std::vector<std::string>& defaultPrefixes() {
+  CONSTRUCT_ON_FIRST_USE(std::vector<std::string>, {"/err/session-", "/err/tcp4-", "/err/tcp6-",
+                                                    "/sys/"});
+}
+
+static bool matchesPrefix(absl::string_view name, const std::vector<std::string>& prefixes) {
+  for (const auto& prefix : prefixes) {
+    if (absl::StartsWith(name, prefix)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string vclVppStatName(absl::string_view vpp_name) {
+  absl::ConsumePrefix(&vpp_name, "/");
+  std::string name(vpp_name);
+  for (char& c : name) {
+    if (c == '/') {
+      c = '.';
+    } else if (!absl::ascii_isalnum(c) && c != '-' && c != '_') {
+      c = '_';
+    }
+  }
+  return name;
+}
+
+VppStatSegment::~VppStatSegment() {
+  if (connected_) {
+    stat_segment_disconnect();
+  }
+}
+
+bool VppStatSegment::read(const std::vector<std::string>& prefixes, std::vector<VppStat>& stats) {
+  if (!connected_) {
+    if (stat_segment_connect(socket_name_.c_str()) != 0) {
+      return false;
+    }
+    connected_ = true;
+  }
+
+  uint8_t** patterns = nullptr;
+  for (const auto& prefix : prefixes) {
+    patterns = stat_segment_string_vector(patterns, ("^" + prefix).c_str());
+  }
+  uint32_t* dir = stat_segment_ls(patterns);
+  stat_segment_vec_free(patterns);
+  stat_segment_data_t* data = dir ? stat_segment_dump(dir) : nullptr;
+  stat_segment_vec_free(dir);
+  if (data == nullptr) {
+    // Directory changed under the dump or vpp went away, reconnect on the next read
+    ENVOY_LOG(debug, "vcl vpp stats: dump of {} failed", socket_name_);
+    stat_segment_disconnect();
+    connected_ = false;
+    return false;
+  }
+
+  for (int i = 0; i < stat_segment_vec_len(data); i++) {
+    const stat_segment_data_t& stat = data[i];
+    uint64_t value = 0;
+    bool gauge = false;
+    switch (stat.type) {
+    case STAT_DIR_TYPE_SCALAR_INDEX:
+      value = stat.scalar_value;
+      gauge = true;
+      break;
+    case STAT_DIR_TYPE_ERROR_INDEX:
+      for (int t = 0; t < stat_segment_vec_len(stat.error_vector); t++) {
+        value += stat.error_vector[t];
+      }
+      break;
+    case STAT_DIR_TYPE_COUNTER_VECTOR_SIMPLE:
+      for (int t = 0; t < stat_segment_vec_len(stat.simple_counter_vec); t++) {
+        for (int j = 0; j < stat_segment_vec_len(stat.simple_counter_vec[t]); j++) {
+          value += stat.simple_counter_vec[t][j];
+        }
+      }
+      break;
+    case STAT_DIR_TYPE_COUNTER_VECTOR_COMBINED:
+      for (int t = 0; t < stat_segment_vec_len(stat.combined_counter_vec); t++) {
+        for (int j = 0; j < stat_segment_vec_len(stat.combined_counter_vec[t]); j++) {
+          value += stat.combined_counter_vec[t][j].packets;
+        }
+      }
+      break;
+    default:
+      continue;
+    }
+    stats.push_back({stat.name, value, gauge});
+  }
+  stat_segment_data_free(data);
+  return true;
+}
+
+bool VppStatsFile::read(const std::vector<std::string>& prefixes, std::vector<VppStat>& stats) {
+  std::ifstream file(path_);
+  if (!file) {
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    std::string name, type;
+    uint64_t value;
+    if (!(fields >> name >> value) || !matchesPrefix(name, prefixes)) {
+      continue;
+    }
+    fields >> type;
+    stats.push_back({name, value, type == "gauge"});
+  }
+  return true;
+}
+
+VclVppStats::VclVppStats(
+    const envoy::extensions::network::socket_interface::v3::VclSocketInterface::VppStats& config,
+    Api::Api& api, Event::Dispatcher& main_dispatcher, Stats::Scope& scope)
+    : interval_(config.interval_ms() ? std::chrono::milliseconds(config.interval_ms())
+                                     : DefaultInterval),
+      main_dispatcher_(main_dispatcher), publisher_(std::make_shared<VppStatsPublisher>(scope)) {
+  if (!config.file().empty()) {
+    source_ = std::make_unique<VppStatsFile>(config.file());
+  } else {
+    source_ = std::make_unique<VppStatSegment>(
+        config.socket_name().empty() ? DefaultStatsSocket : config.socket_name());
+  }
+  if (config.prefixes().empty()) {
+    prefixes_ = defaultPrefixes();
+  } else {
+    prefixes_.assign(config.prefixes().begin(), config.prefixes().end());
+  }
+  thread_ = api.threadFactory().createThread([this]() { run(); },
+                                             Thread::Options{std::string("vcl-vpp-stats")});
+}
+
+VclVppStats::~VclVppStats() {
+  {
+    absl::MutexLock lock(&mutex_);
+    shutdown_ = true;
+  }
+  thread_->join();
+}
+
+void VclVppStats::run() {
+  // Reads compete with nothing on the data path
+  setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+
+  auto shutdown = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) { return shutdown_; };
+  while (true) {
+    std::vector<VppStat> stats;
+    if (source_->read(prefixes_, stats)) {
+      main_dispatcher_.post([publisher = std::weak_ptr<VppStatsPublisher>(publisher_),
+                             stats = std::move(stats)]() {
+        if (auto locked = publisher.lock()) {
+          locked->publish(stats);
+        }
+      });
+    }
+    absl::MutexLock lock(&mutex_);
+    if (mutex_.AwaitWithTimeout(absl::Condition(&shutdown), absl::FromChrono(interval_))) {
+      return;
+    }
+  }
+}
+
+void VppStatsPublisher::publish(const std::vector<VppStat>& stats) {
+  for (const auto& stat : stats) {
+    if (stat.gauge) {
+      auto it = gauges_.find(stat.name);
+      if (it == gauges_.end()) {
+        Stats::Gauge& gauge = scope_->gaugeFromString(vclVppStatName(stat.name),
+                                                      Stats::Gauge::ImportMode::NeverImport);
+        it = gauges_.emplace(stat.name, &gauge).first;
+      }
+      it->second->set(stat.value);
+      continue;
+    }
+
+    auto it = counters_.find(stat.name);
+    if (it == counters_.end()) {
+      // Counts before envoy started are not republished
+      Stats::Counter& counter = scope_->counterFromString(vclVppStatName(stat.name));
+      counters_.emplace(stat.name, Counter{&counter, stat.value});
+      continue;
+    }
+    // Vpp counters restart from 0 when vpp does
+    Counter& counter = it->second;
+    counter.counter->add(stat.value >= counter.last_value ? stat.value - counter.last_value
+                                                         : stat.value);
+    counter.last_value = stat.value;
+  }
+}
+
+} // namespace Vcl
+} // namespace Network
+} // namespace Extensions
+} // namespace Envoy
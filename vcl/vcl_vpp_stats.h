@@ -0,0 +1,121 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "envoy/api/api.h"
+#include "envoy/event/dispatcher.h"
+#include "envoy/stats/scope.h"
+#include "envoy/thread/thread.h"
+
+#include "source/common/common/logger.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "vcl/vcl_socket_interface.pb.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Network {
+namespace Vcl {
+
+// Vpp stat, summed across vpp threads and vector entries.
+struct VppStat {
+  std::string name;
+  uint64_t value;
+  // Scalars are republished as gauges, everything else as counters
+  bool gauge;
+};
+
+// Where vpp stats are read from.
+class VppStatsSource {
+public:
+  virtual ~VppStatsSource() = default;
+
+  // Reads the stats whose names start with one of prefixes. Returns false if stats are
+  // unavailable, e.g., vpp is not running.
+  virtual bool read(const std::vector<std::string>& prefixes, std::vector<VppStat>& stats) PURE;
+};
+
+using VppStatsSourcePtr = std::unique_ptr<VppStatsSource>;
+
+// Vpp's shared memory stats segment, through vpp's stat client. Connects on first read and again
+// after vpp restarts.
+class VppStatSegment : public VppStatsSource, Logger::Loggable<Logger::Id::main> {
+public:
+  explicit VppStatSegment(const std::string& socket_name) : socket_name_(socket_name) {}
+  ~VppStatSegment() override;
+
+  bool read(const std::vector<std::string>& prefixes, std::vector<VppStat>& stats) override;
+
+private:
+  const std::string socket_name_;
+  bool connected_{false};
+};
+
+// Stand-in for the stats segment: a text file with one "<name> <value>" line per counter and
+// "<name> <value> gauge" per gauge, read again on every read.
+class VppStatsFile : public VppStatsSource {
+public:
+  explicit VppStatsFile(const std::string& path) : path_(path) {}
+
+  bool read(const std::vector<std::string>& prefixes, std::vector<VppStat>& stats) override;
+
+private:
+  const std::string path_;
+};
+
+// Republishes vpp stats as envoy stats under vcl.vpp. of scope. Counters add what vpp counted
+// since the previous sample, so counts before the first sample are left out, and a count lower
+// than the previous one is taken as vpp having restarted from 0.
+class VppStatsPublisher {
+public:
+  explicit VppStatsPublisher(Stats::Scope& scope) : scope_(scope.createScope("vcl.vpp.")) {}
+  void publish(const std::vector<VppStat>& stats);
+
+private:
+  struct Counter {
+    Stats::Counter* counter;
+    uint64_t last_value;
+  };
+
+  Stats::ScopePtr scope_;
+  absl::flat_hash_map<std::string, Counter> counters_;
+  absl::flat_hash_map<std::string, Stats::Gauge*> gauges_;
+};
+
+// Periodically reads vpp stats on a low priority thread and republishes them on the main thread
+// under vcl.vpp., with vpp's stat name as suffix.
+class VclVppStats : Logger::Loggable<Logger::Id::main> {
+public:
+  VclVppStats(
+      const envoy::extensions::network::socket_interface::v3::VclSocketInterface::VppStats& config,
+      Api::Api& api, Event::Dispatcher& main_dispatcher, Stats::Scope& scope);
+  ~VclVppStats();
+
+private:
+  void run();
+
+  VppStatsSourcePtr source_;
+  std::vector<std::string> prefixes_;
+  const std::chrono::milliseconds interval_;
+  Event::Dispatcher& main_dispatcher_;
+  // Only touched by the main thread. Posted reads only publish while the publisher is alive.
+  std::shared_ptr<VppStatsPublisher> publisher_;
+  absl::Mutex mutex_;
+  bool shutdown_ ABSL_GUARDED_BY(mutex_){false};
+  Thread::ThreadPtr thread_;
+};
+
+using VclVppStatsPtr = std::unique_ptr<VclVppStats>;
+
+// Vpp stat name as an envoy stat name suffix, e.g., /err/tcp4-output/no buffer becomes
+// err.tcp4-output.no_buffer.
+std::string vclVppStatName(absl::string_view vpp_name);
+
+} // namespace Vcl
+} // namespace Network
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,146 @@
+#include "vcl/vcl_worker_placement.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <fstream>
+
+#include "source/common/common/assert.h"
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Network {
+namespace Vcl {
+
+// Numa node of every cpu, from the cpu lists of the nodes in sysfs. Read once, cpus don't move
+// between nodes.
+static std::vector<int> readCpuNumaNodes() {
+  std::vector<int> nodes(CPU_SETSIZE, -1);
+  DIR* dir = opendir("/sys/devices/system/node");
+  if (dir == nullptr) {
+    return nodes;
+  }
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    int node;
+    if (sscanf(entry->d_name, "node%d", &node) != 1) {
+      continue;
+    }
+    // e.g., 0-3,8-11
+    std::ifstream file(fmt::format("/sys/devices/system/node/{}/cpulist", entry->d_name));
+    std::string cpulist;
+    std::getline(file, cpulist);
+    for (absl::string_view range : absl::StrSplit(cpulist, ',', absl::SkipWhitespace())) {
+      std::pair<absl::string_view, absl::string_view> bounds = absl::StrSplit(range, '-');
+      uint32_t first, last;
+      if (!absl::SimpleAtoi(bounds.first, &first)) {
+        continue;
+      }
+      if (bounds.second.empty()) {
+        last = first;
+      } else if (!absl::SimpleAtoi(bounds.second, &last)) {
+        continue;
+      }
+      for (uint32_t cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+        nodes[cpu] = node;
+      }
+    }
+  }
+  closedir(dir);
+  return nodes;
+}
+
+int VclWorkerPlacement::cpuNumaNode(uint32_t cpu) {
+  static const std::vector<int> nodes = readCpuNumaNodes();
+  return cpu < nodes.size() ? nodes[cpu] : -1;
+}
+
+VclWorkerPlacement::VclWorkerPlacement(
+    const envoy::extensions::network::socket_interface::v3::VclSocketInterface::WorkerPlacement&
+        config) {
+  // Explicit placement wins
+  if (!config.worker_cpus().empty()) {
+    worker_cpus_.assign(config.worker_cpus().begin(), config.worker_cpus().end());
+    return;
+  }
+
+  // Otherwise, take free cpus out of envoy's affinity mask on the vpp workers' numa nodes, one per
+  // vpp worker in turn. Pairing is nominal, see the config.
+  std::vector<uint32_t> vpp_cpus(config.vpp_worker_cpus().begin(), config.vpp_worker_cpus().end());
+  if (vpp_cpus.empty()) {
+    return;
+  }
+
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  if (sched_getaffinity(0, sizeof(cpuset), &cpuset)) {
+    ENVOY_LOG(warn, "vcl worker placement: failed to get cpu affinity, workers not pinned");
+    return;
+  }
+  std::vector<uint32_t> free_cpus;
+  for (uint32_t cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &cpuset) &&
+        std::find(vpp_cpus.begin(), vpp_cpus.end(), cpu) == vpp_cpus.end()) {
+      free_cpus.push_back(cpu);
+    }
+  }
+
+  std::vector<int> vpp_nodes;
+  for (uint32_t vpp_cpu : vpp_cpus) {
+    vpp_nodes.push_back(cpuNumaNode(vpp_cpu));
+  }
+  while (!free_cpus.empty()) {
+    const size_t n_assigned = worker_cpus_.size();
+    for (int node : vpp_nodes) {
+      auto it = std::find_if(free_cpus.begin(), free_cpus.end(),
+                             [node](uint32_t cpu) { return cpuNumaNode(cpu) == node; });
+      if (it == free_cpus.end()) {
+        continue;
+      }
+      worker_cpus_.push_back(*it);
+      free_cpus.erase(it);
+    }
+    // No cpus left on any of the vpp workers' numa nodes
+    if (worker_cpus_.size() == n_assigned) {
+      break;
+    }
+  }
+
+  if (worker_cpus_.empty()) {
+    ENVOY_LOG(warn, "vcl worker placement: no cpus available on vpp workers' numa nodes");
+  }
+}
+
+int VclWorkerPlacement::workerCpu(uint32_t wrk_index) const {
+  if (wrk_index == 0 || worker_cpus_.empty()) {
+    return -1;
+  }
+  return worker_cpus_[(wrk_index - 1) % worker_cpus_.size()];
+}
+
+void VclWorkerPlacement::pinWorker(uint32_t wrk_index) const {
+  const int cpu = workerCpu(wrk_index);
+  if (cpu < 0) {
+    return;
+  }
+
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  CPU_SET(cpu, &cpuset);
+  int rv = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+  if (rv) {
+    ENVOY_LOG(warn, "vcl worker {}: failed to pin to cpu {}: {}", wrk_index, cpu, rv);
+    return;
+  }
+  ENVOY_LOG(info, "vcl worker {} pinned to cpu {} numa {}", wrk_index, cpu, cpuNumaNode(cpu));
+}
+
+} // namespace Vcl
+} // namespace Network
+} // namespace Extensions
+} // namespace Envoy
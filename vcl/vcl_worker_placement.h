@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "source/common/common/logger.h"
+
+#include "vcl/vcl_socket_interface.pb.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Network {
+namespace Vcl {
+
+// Pins envoy workers to cpus, either the configured ones or cpus on the numa nodes of vpp's
+// workers. Workers are matched to cpus by vcl worker index, so which worker gets which cpu, and
+// which vpp thread serves it, is not controlled.
+class VclWorkerPlacement : Logger::Loggable<Logger::Id::main> {
+public:
+  explicit VclWorkerPlacement(
+      const envoy::extensions::network::socket_interface::v3::VclSocketInterface::WorkerPlacement&
+          config);
+
+  // Cpu assigned to vcl worker wrk_index, or -1 if it should not be pinned. Worker 0 is the main
+  // thread and is never pinned.
+  int workerCpu(uint32_t wrk_index) const;
+  // Pins the calling thread, registered as vcl worker wrk_index, to its cpu.
+  void pinWorker(uint32_t wrk_index) const;
+
+  // Numa node of cpu, or -1 if unknown.
+  static int cpuNumaNode(uint32_t cpu);
+
+private:
+  // Envoy worker cpus, in envoy worker order.
+  std::vector<uint32_t> worker_cpus_;
+};
+
+using VclWorkerPlacementPtr = std::unique_ptr<VclWorkerPlacement>;
+
+} // namespace Vcl
+} // namespace Network
+} // namespace Extensions
+} // namespace Envoy